@@ -0,0 +1,122 @@
+#!/bin/sh
+#
+# bench.sh - rerun a fixed subset of the timing examples in the headers of
+# find-lcs.c and tradegu.c and compare them with a stored baseline.
+#
+# Usage: bench/bench.sh [-u] [-t seconds] [-o results]
+#   -u  write the results to the baseline instead of comparing
+#   -t  time cap for each run (default 600)
+#   -o  results file (default bench/results.tsv)
+#
+# Run from anywhere; the programs are built into a temporary directory with
+# the compile lines from the headers (CC and CFLAGS override gcc -O3).
+# Each line of the results is tab separated:
+#   name  seconds  status  squares  found  solved
+# where squares is the number of squares reduced (find-lcs -c), found the
+# number of critical sets printed and solved the number of squares tradegu
+# shows to have no critical set of size n^2/4 - 1 or less ("infeasible").
+# status is ok, or timeout if the cap was hit (the counts are then partial).
+#
+# A run is reported as CHANGED when its counts differ from the baseline and
+# as SLOWER when it takes more than 1.5 times (and 1 second more than) the
+# baseline time; the exit status is 1 if any run is CHANGED.  The baseline
+# times are for the machine that wrote it, so rewrite it (-u) before
+# comparing times on another machine.
+
+cd "$(dirname "$0")/.." || exit 1
+bench=bench
+baseline=$bench/baseline.tsv
+results=$bench/results.tsv
+cap=600
+update=0
+while getopts ut:o: opt; do
+	case $opt in
+	u) update=1 ;;
+	t) cap=$OPTARG ;;
+	o) results=$OPTARG ;;
+	*) sed -n 's/^# Usage: /usage: /p' "$0"; exit 2 ;;
+	esac
+done
+
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:--O3}
+bin=$(mktemp -d) || exit 1
+trap 'rm -rf "$bin"' EXIT
+$CC $CFLAGS -o "$bin/find-lcs" find-lcs.c dlx.c sqfile.c -lpthread || exit 1
+$CC $CFLAGS -o "$bin/tradegu" tradegu.c dlx.c sqfile.c -lpthread || exit 1
+
+# the runs: program and arguments (recflag 3 runs use a fixed seed)
+runs() {
+	cat <<'END'
+find-lcs 6 18 27 1 0
+find-lcs 6 18 27 1 1
+find-lcs 6 18 27 1 2
+find-lcs -r 1 6 15 20 1 3
+find-lcs 6 17 0 1 2
+find-lcs 7 25 42 1 0
+find-lcs 7 25 42 1 1
+find-lcs -s 6 18 0 1 1
+find-lcs -f 7list 7 0 0 0 1
+tradegu 6list 1 12 6 3 10
+tradegu 7list 1 147 7 2 4
+tradegu 7list 1 147 7 2 6
+tradegu 7list 1 147 7 2 8
+tradegu 7list 1 147 7 2 10
+tradegu 7list 1 147 7 3 6
+tradegu 7list 1 147 7 3 8
+tradegu 7list 1 147 7 3 9
+END
+}
+
+now() {
+	date +%s.%N
+}
+
+: > "$results"
+runs | while read -r prog args; do
+	out=$bin/out
+	err=$bin/err
+	start=$(now)
+	case $prog in
+	find-lcs) timeout "$cap" "$bin/find-lcs" -c $args > "$out" 2> "$err" ;;
+	*) timeout "$cap" "$bin/$prog" $args > "$out" 2> "$err" ;;
+	esac
+	code=$?
+	end=$(now)
+	status=ok
+	[ $code -eq 124 ] && status=timeout
+	[ $code -ne 0 ] && [ $code -ne 124 ] && status=error$code
+	secs=$(awk -v s="$start" -v e="$end" 'BEGIN { printf "%.2f", e - s }')
+	squares=$(awk '/squares reduced/ { print $1 }' "$err")
+	found=$(grep -c '^[0-9]*:[0-9]*$' "$out")
+	solved=$(grep -c ' infeasible$' "$out")
+	if [ "$prog" = tradegu ]; then
+		squares=$(wc -l < "$out" | tr -d ' ')
+		found=-
+	fi
+	printf '%s\t%s\t%s\t%s\t%s\t%s\n' "$prog $args" "$secs" "$status" \
+	    "${squares:--}" "$found" "$solved" | tee -a "$results"
+done
+
+if [ $update -eq 1 ]; then
+	cp "$results" "$baseline"
+	echo "baseline written to $baseline"
+	exit 0
+fi
+[ -f "$baseline" ] || { echo "no baseline in $baseline"; exit 0; }
+
+# compare with the baseline, run by run
+awk -F '\t' '
+NR == FNR { t[$1] = $2; c[$1] = $3 " " $4 " " $5 " " $6; next }
+!($1 in t) { print "NEW     " $1; next }
+{
+	if ($3 " " $4 " " $5 " " $6 != c[$1]) {
+		print "CHANGED " $1 ": " c[$1] " -> " $3 " " $4 " " $5 " " $6
+		bad = 1
+	} else if ($2 > 1.5 * t[$1] && $2 > t[$1] + 1)
+		print "SLOWER  " $1 ": " t[$1] "s -> " $2 "s"
+	else if ($2 < t[$1] / 1.5 && $2 < t[$1] - 1)
+		print "FASTER  " $1 ": " t[$1] "s -> " $2 "s"
+}
+END { exit bad }
+' "$baseline" "$results"
@@ -0,0 +1,256 @@
+/*
+ * dlx.c - Dancing Links exact cover engine for Latin square completion.
+ * See dlx.h for the interface.
+ *
+ * Nodes live in flat arrays.  Node 0 is the root, nodes 1..3n^2 are the
+ * column headers and the three nodes of the triple (r, c, v) start at
+ * 1 + 3n^2 + 3((r n + c) n + v - 1), so the triple of any node can be
+ * worked out from its index without a separate table.
+ *
+ * Header columns: 1 + r n + c           cell (r, c) is filled
+ *                 1 + n^2 + r n + v-1   row r holds symbol v
+ *                 1 + 2n^2 + c n + v-1  column c holds symbol v
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dlx.h"
+
+struct dlx {
+	int             n, stride;
+	int             cols;		/* 3n^2 */
+	int             base;		/* first row node */
+	int            *L, *R, *U, *D, *C;
+	int            *S;		/* column sizes */
+	char           *covered;	/* column covered by a primed entry */
+	int            *O;		/* rows chosen by the search */
+	int            *P;		/* rows chosen by priming */
+	int            *sq;		/* the square handed to visit() */
+	long            found, cap;
+	dlx_visit       visit;
+	void           *arg;
+	int             stop;
+};
+
+static void
+cover(struct dlx *d, int c)
+{
+	int             i, j;
+
+	d->R[d->L[c]] = d->R[c];
+	d->L[d->R[c]] = d->L[c];
+	for (i = d->D[c]; i != c; i = d->D[i])
+		for (j = d->R[i]; j != i; j = d->R[j]) {
+			d->D[d->U[j]] = d->D[j];
+			d->U[d->D[j]] = d->U[j];
+			d->S[d->C[j]]--;
+		}
+}
+
+static void
+uncover(struct dlx *d, int c)
+{
+	int             i, j;
+
+	for (i = d->U[c]; i != c; i = d->U[i])
+		for (j = d->L[i]; j != i; j = d->L[j]) {
+			d->S[d->C[j]]++;
+			d->D[d->U[j]] = j;
+			d->U[d->D[j]] = j;
+		}
+	d->R[d->L[c]] = c;
+	d->L[d->R[c]] = c;
+}
+
+/* cover every column of the row containing node r, r's own first */
+static void
+select_row(struct dlx *d, int r)
+{
+	int             j;
+
+	cover(d, d->C[r]);
+	for (j = d->R[r]; j != r; j = d->R[j])
+		cover(d, d->C[j]);
+}
+
+static void
+unselect_row(struct dlx *d, int r)
+{
+	int             j;
+
+	for (j = d->L[r]; j != r; j = d->L[j])
+		uncover(d, d->C[j]);
+	uncover(d, d->C[r]);
+}
+
+/* write the triple of row node r into the square (v = 0 clears it) */
+static void
+put(struct dlx *d, int r, int clear)
+{
+	int             q = (r - d->base) / 3, n = d->n;
+
+	d->sq[(q / n / n) * d->stride + (q / n) % n] = clear ? 0 : q % n + 1;
+}
+
+struct dlx     *
+dlx_new(int n, int stride)
+{
+	struct dlx     *d;
+	int             nodes, i, r, c, v, x, k;
+
+	d = (struct dlx *) calloc(1, sizeof(struct dlx));
+	if (!d) {
+		printf("dlx_new: out of memory\n");
+		exit(1);
+	}
+	d->n = n;
+	d->stride = stride;
+	d->cols = 3 * n * n;
+	d->base = d->cols + 1;
+	nodes = d->base + 3 * n * n * n;
+	d->L = (int *) malloc(5 * nodes * sizeof(int));
+	d->S = (int *) calloc(d->cols + 1, sizeof(int));
+	d->covered = (char *) calloc(d->cols + 1, 1);
+	d->O = (int *) malloc(n * n * sizeof(int));
+	d->P = (int *) malloc(n * n * sizeof(int));
+	d->sq = (int *) calloc(n * stride, sizeof(int));
+	if (!d->L || !d->S || !d->covered || !d->O || !d->P || !d->sq) {
+		printf("dlx_new: out of memory\n");
+		exit(1);
+	}
+	d->R = d->L + nodes;
+	d->U = d->R + nodes;
+	d->D = d->U + nodes;
+	d->C = d->D + nodes;
+
+	/* the root and the column headers form one circular list */
+	for (i = 0; i <= d->cols; i++) {
+		d->L[i] = i ? i - 1 : d->cols;
+		d->R[i] = i < d->cols ? i + 1 : 0;
+		d->U[i] = d->D[i] = d->C[i] = i;
+	}
+	/* one row of three nodes per (r, c, v), appended to each column */
+	x = d->base;
+	for (r = 0; r < n; r++)
+		for (c = 0; c < n; c++)
+			for (v = 0; v < n; v++) {
+				int             col[3];
+
+				col[0] = 1 + r * n + c;
+				col[1] = 1 + n * n + r * n + v;
+				col[2] = 1 + 2 * n * n + c * n + v;
+				for (k = 0; k < 3; k++, x++) {
+					d->C[x] = col[k];
+					d->U[x] = d->U[col[k]];
+					d->D[x] = col[k];
+					d->D[d->U[col[k]]] = x;
+					d->U[col[k]] = x;
+					d->S[col[k]]++;
+					d->L[x] = k ? x - 1 : x + 2;
+					d->R[x] = k < 2 ? x + 1 : x - 2;
+				}
+			}
+	return d;
+}
+
+void
+dlx_free(struct dlx *d)
+{
+	if (!d)
+		return;
+	free(d->L);
+	free(d->S);
+	free(d->covered);
+	free(d->O);
+	free(d->P);
+	free(d->sq);
+	free(d);
+}
+
+static void
+search(struct dlx *d, int k)
+{
+	int             c, j, r, min;
+
+	if (d->R[0] == 0) {
+		d->found++;
+		if (d->visit) {
+			for (j = 0; j < k; j++)
+				put(d, d->O[j], 0);
+			if (d->visit(d->sq, d->arg))
+				d->stop = 1;
+			for (j = 0; j < k; j++)
+				put(d, d->O[j], 1);
+		}
+		if (d->cap > 0 && d->found >= d->cap)
+			d->stop = 1;
+		return;
+	}
+	/* branch on the constraint with the fewest ways to meet it */
+	c = d->R[0];
+	min = d->S[c];
+	for (j = d->R[c]; j && min > 1; j = d->R[j])
+		if (d->S[j] < min) {
+			c = j;
+			min = d->S[j];
+		}
+	if (min == 0)
+		return;
+
+	cover(d, c);
+	for (r = d->D[c]; r != c && !d->stop; r = d->D[r]) {
+		d->O[k] = r;
+		for (j = d->R[r]; j != r; j = d->R[j])
+			cover(d, d->C[j]);
+		search(d, k + 1);
+		for (j = d->L[r]; j != r; j = d->L[j])
+			uncover(d, d->C[j]);
+	}
+	uncover(d, c);
+}
+
+long
+dlx_complete(struct dlx *d, int *s, long cap, dlx_visit visit, void *arg)
+{
+	int             n = d->n, r, c, v, p = 0, i;
+
+	d->found = 0;
+	d->cap = cap;
+	d->visit = visit;
+	d->arg = arg;
+	d->stop = 0;
+
+	/* prime: select the row of every given entry */
+	for (r = 0; r < n; r++)
+		for (c = 0; c < n; c++) {
+			d->sq[r * d->stride + c] = v = s[r * d->stride + c];
+			if (!v)
+				continue;
+			if (d->covered[1 + r * n + c] ||
+			    d->covered[1 + n * n + r * n + v - 1] ||
+			    d->covered[1 + 2 * n * n + c * n + v - 1])
+				goto UNPRIME;
+			d->covered[1 + r * n + c] = 1;
+			d->covered[1 + n * n + r * n + v - 1] = 1;
+			d->covered[1 + 2 * n * n + c * n + v - 1] = 1;
+			d->P[p] = d->base + 3 * ((r * n + c) * n + v - 1);
+			select_row(d, d->P[p++]);
+		}
+
+	search(d, 0);
+
+UNPRIME:
+	for (i = p - 1; i >= 0; i--) {
+		int             q = (d->P[i] - d->base) / 3;
+
+		unselect_row(d, d->P[i]);
+		r = q / n / n;
+		c = (q / n) % n;
+		v = q % n;
+		d->covered[1 + r * n + c] = 0;
+		d->covered[1 + n * n + r * n + v] = 0;
+		d->covered[1 + 2 * n * n + c * n + v] = 0;
+	}
+	return d->found;
+}
@@ -0,0 +1,40 @@
+/*
+ * dlx.h - Knuth's Dancing Links (Algorithm X) for completing partial Latin
+ * squares, shared by find-lcs and tradegu.
+ *
+ * An order n square is the exact cover problem with 3n^2 constraints: every
+ * cell holds one symbol, every row holds every symbol once and every column
+ * holds every symbol once.  Each of the n^3 (row, column, symbol) triples
+ * covers one constraint of each kind.
+ *
+ * Squares are passed as int arrays with symbols 1..n and 0 for an empty
+ * cell; stride is the length of a row in the caller's array, so both
+ * int s[SIZE][SIZE] layouts can be handed over as &s[0][0], SIZE.
+ */
+
+#ifndef DLX_H
+#define DLX_H
+
+struct dlx;
+
+/*
+ * called with each completion (same layout as the square passed to
+ * dlx_complete()); return nonzero to stop the search.  The array belongs to
+ * the engine and must be copied if it is to be changed.
+ */
+typedef int     (*dlx_visit) (int *s, void *arg);
+
+struct dlx     *dlx_new(int n, int stride);
+void            dlx_free(struct dlx *d);
+
+/*
+ * Prime the engine with the partial square s, then find its completions,
+ * calling visit (if not NULL) for each one.  The search stops after cap
+ * completions when cap > 0, so a cap of 2 answers "is it unique?".
+ * Returns the number of completions found, 0 if the entries of s already
+ * clash.  The engine is left ready for the next call.
+ */
+long            dlx_complete(struct dlx *d, int *s, long cap, dlx_visit visit,
+			     void *arg);
+
+#endif
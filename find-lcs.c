@@ -9,6 +9,53 @@
 when generating all completions.  simple fill() used from PLS with 1..n
 in first row and column */
 
+/* with -d, both are replaced by the Dancing Links engine in dlx.c */
+
+/* fill(), fill2() and the recurse*() functions live in kernels.h, which
+is compiled once for each order from 5 to 12, with the order a constant,
+and once for any other order; squares are kept one byte per entry */
+
+/* with -s, only the smallest square of each main class (under row,
+column and symbol permutations and conjugacy) is reduced */
+
+/* with -j N, the fill() tree is cut into prefix tasks which N threads
+share out by work stealing; output stays one square per line */
+
+/* with -f FILE, the squares in FILE (- for stdin, in the formats of
+6list and 7list, as find-lcs prints them or packed by sqpack) are
+reduced one at a time instead of the completions of a partial square;
+-l FIRST-LAST picks which squares (the first is 1) */
+
+/* with --checkpoint FILE, the tasks finished so far (see -j) are saved
+to FILE every minute, and --resume FILE carries on from them */
+
+/* with --manifest FILE, the tasks (see -j) are written to FILE with an
+estimate of the work in each; --shard i/N --manifest FILE then runs
+shard i of N of them, on this machine or another, and --merge puts the
+outputs of the shards back together; see writemanifest() */
+
+/* with -v FILE, the partial squares in FILE (read as for -f, so in the
+dotted notation of README.md too) are checked to be critical sets: each
+has one completion, and every entry is needed, which the -j threads
+check cell by cell; only the order is given then */
+
+/* recflag 4 reduces each square many times over, in seeded chains of
+random reductions shared out between the -j threads, for -n chains or
+-t seconds; see localsearch() */
+
+/* -r N seeds random() for recflag 3 (and the chains of recflag 4) with
+N rather than the clock; recflag 3 does not take it with -j, as its
+threads share the one random() stream in whatever order they come, and
+-c prints the number of squares reduced (those with at least
+minimum-intercalates intercalates, however they were found) and the
+largest critical set found to stderr at the end; bench/bench.sh uses
+both */
+
+/* compiled with -DSTATS, node counts for the searches are printed to
+stderr at exit and on SIGUSR1, by depth; see stats.h */
+
+/* compile with: gcc -O3 -o find-lcs find-lcs.c dlx.c sqfile.c -lpthread */
+
 /* example running times on an athlon 4 1200 mhz */
 /* where x:y is given, x=number of intercalates, y=size of cs found */
 
@@ -65,46 +112,332 @@ in first row and column */
 
 #define SIZE 26
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>		/* for getopt_long() */
+#include <pthread.h>
 #include <sys/time.h>		/* for srandom() */
+#include <time.h>
+#include <limits.h>
+#include "dlx.h"
+#include "sqfile.h"
+
+/* counters kept with -DSTATS: fill() and fill2() nodes, dead ends and
+   early exits by level, fill() subtrees cut for too few intercalates,
+   entries fill2() forced, testone() calls by the level of their caller
+   (entries removed in recurse*()), recurse*() levels and their fill2()
+   calls by the number of entries removed, witness hits */
+#define STATS_COUNTERS(X) X(fill_nodes) X(fill_dead_ends) X(fill_ic_cuts) \
+  X(fill2_nodes) \
+  X(fill2_dead_ends) X(fill2_early_exits) X(fill2_forced) X(testone_calls) \
+  X(recurse_levels) X(recurse_fill2) X(witness_hits)
+#include "stats.h"
+
+/* one byte per entry, so that a square of order 10 fits in 260 bytes */
+typedef unsigned char entry;
+
+/* the kernels for one order, from kernels.h */
+struct kernels
+{
+  int (*fill) (entry s[SIZE][SIZE], int level, int pos);
+  int (*fill2) (entry s[SIZE][SIZE], int level, int pos);
+  int (*icount) (entry s[SIZE][SIZE]);
+  double (*probe) (entry s[SIZE][SIZE], int level, int pos);
+  void (*recurse[4]) (entry s[SIZE][SIZE], int cs, int ic);	/* by recflag */
+};
 
-void recurse (int s[SIZE][SIZE], int cs, int size, int ic);
-void recursemax (int s[SIZE][SIZE], int cs, int size, int ic);
-void recursemin (int s[SIZE][SIZE], int cs, int size, int ic);
-void recursernd (int s[SIZE][SIZE], int cs, int size, int ic);
-int fill2 (int s[SIZE][SIZE], int level, int pos, int size);
-int fill (int s[SIZE][SIZE], int level, int pos, int size);
-int icount (int s[SIZE][SIZE], int size);
-struct bitmap testone (int s[SIZE][SIZE], int a, int b, int size);
-void print (int s[SIZE][SIZE], int size);
+const struct kernels *kernelsof (int size);
+void reduce (entry s[SIZE][SIZE], int size, int ic);
+void initbound (entry s[SIZE][SIZE], int size);
+void initic (entry s[SIZE][SIZE], int size);
+unsigned int testone (int a, int b, int level);
+void initused (entry s[SIZE][SIZE], int size);
+void print (entry s[SIZE][SIZE], int size);
+void report (entry s[SIZE][SIZE], int size, int ic, int cs);
 void display (int array[200][200]);
-int max = 0, minsize, mininter, recflag;
-int count = 0;
+void parallel (entry s[SIZE][SIZE], int level, int size, int threads);
+int newclass (entry s[SIZE][SIZE], int size);
+void initseen (int size);
+void loadcheckpoint (char *file, int size);
+void streamsquares (struct sqfile *f, long first, long last, int size,
+		    int threads);
+void localsearch (entry s[SIZE][SIZE], int size, int ic);
+void writemanifest (char *file, entry s[SIZE][SIZE], int level, int size,
+		    int depth);
+void loadmanifest (char *file, entry s[SIZE][SIZE], int level, int size);
+int mergeshards (int n, char **names);
+int verifysquares (char *name, long first, long last, int size, int threads);
+int max = 0, minsize, mininter, use, recflag, usedlx = 0, symflag = 0;
+char *ckfile = NULL;		/* checkpoint file, if any */
+int shard = 0, shards = 0;	/* --shard i/N, or none */
+long squares = 0;		/* count summed over all threads */
+int order;			/* of the squares, for the ORDER 0 kernels */
+const struct kernels *kern;	/* the kernels for that order */
+int chainthreads = 1;		/* recflag 4: -j, the budgets -n and -t */
+long chains = -1, seconds = 0;
+unsigned long long chainseed;
 int array[200][200];		/* array */
+pthread_mutex_t outlock = PTHREAD_MUTEX_INITIALIZER;
+
+/* everything below is private to the thread doing the search */
+
+__thread int count = 0;
+__thread struct dlx *dlxfill, *dlxfill2;	/* NULL unless -d */
+__thread unsigned long long rndstate;	/* for rnd() */
+
+static inline unsigned long long
+rnd (void)
+{
+  /* splitmix64, for the annealing chains and the manifest estimates:
+     the stream depends only on the seed put in rndstate */
+  unsigned long long z = (rndstate += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/* Trade witnesses.  When fill2() finds a completion of a reduced
+   square that is not latin[][], the square being reduced, the cells
+   where the two differ are a trade.  The recurse*() functions only
+   ever empty cells, so once every cell of a witness is empty the
+   partial square has two completions however far it is reduced, and
+   removing such a cell needs no fill2() call. */
+#define CELLWORDS ((SIZE * SIZE + 63) / 64)
+struct cells
+{
+  unsigned long long w[CELLWORDS];
+};
+int cellwords;
+__thread entry latin[SIZE][SIZE];
+__thread struct cells *witness;
+__thread int witnesses = 0, maxwitnesses = 0;
+void addwitness (entry s[SIZE][SIZE], int size);
+void filled (entry s[SIZE][SIZE], int size, struct cells *p);
+int witnessed (struct cells *p, int q);
+
+/* bit v of rowused[r] (colused[c]) is set when symbol v occurs in
+   row r (column c) of the square being worked on; full has bits
+   1..size set.  setcell() and clearcell() keep them up to date, so
+   the candidates for an empty cell are one AND away. */
+__thread unsigned int rowused[SIZE], colused[(SIZE + 7) & ~7];
+unsigned int full;
+
+static inline void
+setcell (entry s[SIZE][SIZE], int a, int b, int v)
+{
+  s[a][b] = v;
+  rowused[a] |= 1u << v;
+  colused[b] |= 1u << v;
+}
+
+static inline void
+clearcell (entry s[SIZE][SIZE], int a, int b)
+{
+  unsigned int m = ~(1u << s[a][b]);
+  s[a][b] = 0;
+  rowused[a] &= m;
+  colused[b] &= m;
+}
+
+/* fill2() works out the candidates of all the cells of a square at
+   once, eight cells at a time in GCC vectors, in sweep() from
+   kernels.h: it is cloned for AVX2, SSE4.1 and plain x86-64, and the
+   best the machine has is picked at load time.  It fills a struct
+   sweep, and gives the cell to branch on as its number of candidates
+   times 1024 plus its position, so that the smallest of them is the
+   first cell with fewest candidates; NOCELL when there is no empty
+   cell. */
+typedef unsigned int lanes __attribute__ ((vector_size (32)));
+typedef unsigned char lanebytes __attribute__ ((vector_size (8)));
+#define NOCELL 0x7fffffffu
+#define CANDCOLS ((SIZE + 7) & ~7)	/* columns rounded up to vectors */
+struct sweep
+{
+  unsigned int cand[SIZE][CANDCOLS];	/* 0 for a filled cell */
+  /* by line, rows then columns: the symbols that are candidates in
+     at least one cell of the line, and in at least two */
+  unsigned int once[SIZE + CANDCOLS], twice[SIZE + CANDCOLS];
+};
+#ifdef __x86_64__
+#define CLONED __attribute__ ((target_clones ("avx2", "sse4.1", "default")))
+#else
+#define CLONED
+#endif
+
+/* Intercalate tracking for mininter.  fill() places cells in row
+   order, and counts each intercalate when its last cell is placed in
+   fillic.  The last cell (r, c) completes at most one intercalate per
+   other filled cell of row r, and of column c, so icbound[pos], the
+   sum of those limits over the cells still empty from pos on, bounds
+   the intercalates the square can still gain.  colrow[c][v] is the
+   row of symbol v in column c while colused[c] says v is there. */
+int icbound[SIZE * SIZE + 1];
+__thread int fillic;
+__thread entry colrow[SIZE][SIZE + 1];
 
 main (int argc, char **argv)
 {
-  int s[SIZE][SIZE], size, i, j, k;
-  int use;
+  entry s[SIZE][SIZE];
+  int size, i, j, k;
   struct timeval tp;
   struct timezone tzp;
-  if (argc != 6)
+  int opt, threads = 0, level, resume = 0, seed = -1, counts = 0;
+  int merge = 0, depth = 0;
+  char *sqname = NULL, *vname = NULL, *manifest = NULL;
+  long first = 1, last = LONG_MAX;
+  struct sqfile *sqf = NULL;
+  static struct option longopts[] = {
+    {"checkpoint", required_argument, NULL, 'C'},
+    {"resume", required_argument, NULL, 'R'},
+    {"manifest", required_argument, NULL, 'M'},
+    {"depth", required_argument, NULL, 'D'},
+    {"shard", required_argument, NULL, 'S'},
+    {"merge", no_argument, NULL, 'G'},
+    {NULL, 0, NULL, 0}
+  };
+  stats_init ();
+  while ((opt = getopt_long (argc, argv, "cdf:j:l:n:r:st:v:", longopts, NULL)) != -1)
+    {
+      if (opt == 'C' || opt == 'R')
+	{
+	  ckfile = optarg;
+	  resume = opt == 'R';
+	}
+      else if (opt == 'M')
+	manifest = optarg;
+      else if (opt == 'D' && atoi (optarg) > 0)
+	depth = atoi (optarg);
+      else if (opt == 'S' && sscanf (optarg, "%d/%d", &shard, &shards) == 2
+	       && shard >= 1 && shard <= shards)
+	;
+      else if (opt == 'G')
+	merge = 1;
+      else if (opt == 'c')
+	counts = 1;
+      else if (opt == 'd')
+	usedlx = 1;
+      else if (opt == 'f')
+	sqname = optarg;
+      else if (opt == 'l' && sscanf (optarg, "%ld-%ld", &first, &last) >= 1
+	       && first > 0)
+	;
+      else if (opt == 'n' && atol (optarg) > 0)
+	chains = atol (optarg);
+      else if (opt == 'r' && atoi (optarg) >= 0)
+	seed = atoi (optarg);
+      else if (opt == 't' && atol (optarg) > 0)
+	seconds = atol (optarg);
+      else if (opt == 's')
+	symflag = 1;
+      else if (opt == 'j' && atoi (optarg) > 0)
+	threads = atoi (optarg);
+      else if (opt == 'v')
+	vname = optarg;
+      else
+	argc = 0;
+    }
+  if (merge && optind < argc)
+    return mergeshards (argc - optind, argv + optind);
+  if (argc - optind != (vname ? 1 : 5) || (shards && !manifest) || merge
+      || (!vname && (atoi (argv[argc - 1]) < 0 || atoi (argv[argc - 1]) > 4)))
     {
       printf
-	("usage: %s order-of-LS minimum-size-wanted minimum-intercalates useflag recflag\n",
+	("usage: %s [-c] [-d] [-f file [-l first-last]] [-j threads] [-n chains] [-r seed] [-s] [-t seconds] [--checkpoint file | --resume file] [--manifest file [--depth depth | --shard i/N]] order-of-LS minimum-size-wanted minimum-intercalates useflag recflag\n",
 	 argv[0]);
+      printf
+	("       %s -v file [-d] [-j threads] [-l first-last] order-of-LS\n",
+	 argv[0]);
+      printf ("       %s --merge shard-output...\n", argv[0]);
+      printf
+	("-c: print the number of squares reduced and the largest critical set to stderr at the end\n");
+      printf
+	("-d: complete squares with Dancing Links instead of fill()/fill2()\n");
+      printf
+	("-f: reduce the squares in this file (- for stdin) instead; useflag is ignored\n");
+      printf
+	("-l: only the squares first to last of the file (the first is 1)\n");
+      printf
+	("-j: share the search between this many threads\n");
+      printf
+	("-n: recflag 4: chains to run on each square (default: one per thread)\n");
+      printf
+	("-r: seed for recflag 3 (not with -j) and 4 (default: from the clock)\n");
+      printf
+	("-s: only reduce one square from each main class\n");
+      printf
+	("-t: recflag 4: seconds to spend on each square\n");
+      printf
+	("-v: check that the partial squares in this file (- for stdin) are critical sets\n");
+      printf
+	("--checkpoint: save the progress of the search to this file every minute\n");
+      printf
+	("--resume: carry on from this checkpoint file, and keep saving to it\n");
+      printf
+	("--manifest: write the tasks of the search, with their estimated work, to this file and stop\n");
+      printf
+	("--depth: cut the tasks of the manifest at this depth (default: deep enough for 4096 tasks)\n");
+      printf
+	("--shard: with --manifest, run only shard i of N of its tasks\n");
+      printf
+	("--merge: combine the outputs of the shards of a search\n");
       printf
 	("useflag: 0 for empty square, 1 for 1..n in first row+col, 2 for 1..n in first row+col and 1s on main diagonal\n");
       printf
-	("recflag: 0 for simple recursion, 1 for remove (i,j) where x_{ij} is max, 2 for where x_{ij} is min, 3 is random\n");
+	("recflag: 0 for simple recursion, 1 for remove (i,j) where x_{ij} is max, 2 for where x_{ij} is min, 3 is random, 4 is annealed random restarts\n");
       exit (0);
     }
+  argv += optind - 1;
   size = atoi (argv[1]);
+  cellwords = (size * size + 63) / 64;
+  full = ((1u << size) - 1) << 1;
+  order = size;
+  kern = kernelsof (size);
+  if (vname)
+    return verifysquares (vname, first, last, size, threads ? threads : 1);
   minsize = atoi (argv[2]);
   mininter = atoi (argv[3]);
   use = atoi (argv[4]);
   recflag = atoi (argv[5]);
+  if (recflag == 3 && seed >= 0 && threads > 1)
+    {
+      printf ("-r does not apply to recflag 3 with -j\n");
+      exit (1);
+    }
+  if (recflag == 4)
+    {
+      /* the threads share out the chains of one square at a time */
+      chainthreads = threads ? threads : 1;
+      if (chains < 0 && !seconds)
+	chains = chainthreads;
+      threads = 0;
+    }
+  if (sqname)
+    {
+      if (ckfile || manifest)
+	{
+	  printf ("--%s does not apply to -f\n",
+		  ckfile ? "checkpoint" : "manifest");
+	  exit (1);
+	}
+      if ((sqf = sqf_open (sqname, size)) == NULL)
+	exit (1);
+      if (!threads)
+	threads = 1;
+    }
+  if ((ckfile || shards) && !threads)
+    threads = 1;		/* checkpoints and shards are made of tasks */
+  if (resume)
+    loadcheckpoint (ckfile, size);
+  if (usedlx && !threads)
+    {
+      dlxfill = dlx_new (size, size);
+      dlxfill2 = dlx_new (size, size);
+    }
   memset (s, 0, sizeof (s));
   memset (array, 0, sizeof (array));
+  if (symflag && (use == 2 || sqf))
+    initseen (size);
 
   /* use standard form */
   for (i = 0; i < SIZE; i++)
@@ -117,96 +450,121 @@ main (int argc, char **argv)
       if (use == 2)
 	s[i][i] = 1;
     }
-  if (recflag == 3)
+  initused (s, size);
+  if (recflag >= 3 && seed < 0)
     {
       gettimeofday (&tp, &tzp);
-      srandom ((int) tp.tv_usec);
+      seed = (int) tp.tv_usec;
     }
+  if (recflag == 3)
+    srandom (seed);
+  chainseed = seed;
   /* call fill() with different arguments depending on the invocation
      on the command line */
-  if (use == 0)
-    fill (s, 0, 0, size);
+  level = 0;
   if (use == 1)
-    fill (s, size + size - 1, 0, size);
+    level = size + size - 1;
   if (use == 2)
-    fill (s, size + size + size - 2, 0, size);
+    level = size + size + size - 2;
+  initbound (s, size);
+  if (shards)
+    loadmanifest (manifest, s, level, size);
+  if (manifest && !shards)
+    writemanifest (manifest, s, level, size, depth);
+  else if (sqf)
+    streamsquares (sqf, first, last, size, threads);
+  else if (threads)
+    parallel (s, level, size, threads);
+  else
+    {
+      initic (s, size);
+      kern->fill (s, level, 0);
+      squares += count;
+    }
+  if (shards)
+    printf ("# shard %d/%d: %ld squares reduced, largest critical set %d\n",
+	    shard, shards, squares, max);
+  if (counts)
+    fprintf (stderr, "%ld squares reduced, largest critical set %d\n",
+	     squares, max);
+  return 0;
 }
 
-int
-icount (int s[SIZE][SIZE], int size)
+void
+initbound (entry s[SIZE][SIZE], int size)
 {
-  /* O(size^3) intercalate counting */
-  int r, c, f, ci[SIZE][SIZE+1], i;
-
-  /* build a row and column index for each row and column */
+  /* work out icbound[] for fill() from the partial square s at the
+     root of the search */
+  int r, c, j, q, limr, limc;
+  icbound[size * size] = 0;
+  for (q = size * size - 1; q >= 0; q--)
+    {
+      r = q / size;
+      c = q % size;
+      icbound[q] = icbound[q + 1];
+      if (s[r][c])
+	continue;
+      /* cells of the row and column filled before (r, c) */
+      limr = c;
+      for (j = c + 1; j < size; j++)
+	limr += s[r][j] != 0;
+      limc = r;
+      for (j = r + 1; j < size; j++)
+	limc += s[j][c] != 0;
+      icbound[q] += limr < limc ? limr : limc;
+    }
+}
 
-  /* ri[x][y] records in which column element y occurs is in row x */
-  /* ci[x][y] records in which row element y is in row x */
+void
+initic (entry s[SIZE][SIZE], int size)
+{
+  /* set up fillic and colrow[][] for the partial square s */
+  int r1, r2, c1, c2;
+  fillic = 0;
+  for (r1 = 0; r1 < size; r1++)
+    for (c1 = 0; c1 < size; c1++)
+      if (s[r1][c1])
+	colrow[c1][s[r1][c1]] = r1;
+  for (r1 = 0; r1 < size; r1++)
+    for (r2 = r1 + 1; r2 < size; r2++)
+      for (c1 = 0; c1 < size; c1++)
+	for (c2 = c1 + 1; c2 < size; c2++)
+	  fillic += s[r1][c1] && s[r1][c1] == s[r2][c2]
+	    && s[r1][c2] && s[r1][c2] == s[r2][c1];
+}
 
-  i = 0;
-  for (r = 0; r < size; r++)
-    for (c = 0; c < size; c++)
-      ci[c][s[r][c]] = r;
-  for (r = 0; r < size - 1; r++)
-    for (c = 0; c < size - 1; c++)
-      for (f = c + 1; f < size; f++)
+void
+initused (entry s[SIZE][SIZE], int size)
+{
+  /* rebuild the row and column symbol masks from scratch */
+  int i, j;
+  for (i = 0; i < size; i++)
+    rowused[i] = colused[i] = 0;
+  for (i = 0; i < size; i++)
+    for (j = 0; j < size; j++)
+      if (s[i][j])
 	{
-	  int e = s[r][f], y = ci[c][e];
-	  if (y < r)
-	    continue;
-	  i += s[r][c] == s[y][f];
+	  rowused[i] |= 1u << s[i][j];
+	  colused[j] |= 1u << s[i][j];
 	}
-  return i;
 }
 
-struct bitmap
-{
-  int count;
-  int values[SIZE + 1];
-};
-
-struct bitmap
-testone (int s[SIZE][SIZE], int a, int b, int size)
+unsigned int
+testone (int a, int b, int level)
 {
   /* A function for testing if the empty cell in row a,
-     column b of the Latin square in the array s
-     has a forced completion. */
-
-  struct bitmap bm;
-  int t[SIZE + 1];
-  int that;
-  int i;
-
-  /* clear the test and values array */
-  for (i = 1; i <= size; i++)
-    {
-      t[i] = 0;
-      bm.values[i] = 0;
-    }
-  bm.count = 0;
-
-  /* for every element in the same row and column
-     as the element being tested, set the
-     corresponding test array element to be 1 */
-  for (i = 0; i < size; i++)
-    t[s[a][i]] = t[s[i][b]] = 1;
+     column b of the Latin square being worked on
+     has a forced completion.  Returns the set of symbols
+     still possible there as a bitmask; __builtin_popcount()
+     gives their number.  level is the caller's, for the
+     counters only. */
 
-  /* keep track of all the different elements used
-     in that row and column */
-  for (i = 1; i <= size; i++)
-    if (!t[i])
-      {
-	bm.values[i] = 1;
-	that = i;
-	bm.count++;
-      }
-
-  /* return those values */
-  return bm;
+  STAT (testone_calls, level);
+  return full & ~(rowused[a] | colused[b]);
 }
 
 void
-print (int s[SIZE][SIZE], int size)
+print (entry s[SIZE][SIZE], int size)
 {
   /* print out the Latin square in the array s */
   int x, y;
@@ -222,225 +580,171 @@ print (int s[SIZE][SIZE], int size)
 }
 
 void
-recurse (int s[SIZE][SIZE], int cs, int size, int ic)
+filled (entry s[SIZE][SIZE], int size, struct cells *p)
 {
-  /* recursively remove entries from a uniquely completable set,
-     until only a critical set is left */
-  int q, badflag = 0;
-  if (cs < minsize)
-    return;
+  /* the set of filled cells of s */
+  int q;
+  memset (p, 0, sizeof (struct cells));
   for (q = 0; q < size * size; q++)
-    {
-      if (s[q / size][q % size])
-	{
-	  int tmp = s[q / size][q % size];
-	  s[q / size][q % size] = 0;
-	  if (fill2 (s, cs - 1, 0, size) == 1)
-	    {
-	      badflag = 1;
-	      break;
-	    }
-	  else
-	    s[q / size][q % size] = tmp;
-	}
-    }
-  if (badflag)
-    recurse (s, cs - 1, size, ic);
-  else
-    {
-      print (s, size);
-      printf ("%d:%d\n", ic, cs);
-      fflush (stdout);
-    }
+    if (s[q / size][q % size])
+      p->w[q / 64] |= 1ULL << (q % 64);
 }
 
 void
-recursemin (int s[SIZE][SIZE], int cs, int size, int ic)
+addwitness (entry s[SIZE][SIZE], int size)
 {
-  /* same as recurse(), except remove entries where ret.count is lowest */
-  int q, badflag = -1;
-  int retmin = 99;
-  if (cs < minsize)
-    return;
+  /* record the trade between the completion s and latin[][],
+     unless a witness inside it is already known */
+  struct cells d;
+  int q, i, j;
+  memset (&d, 0, sizeof (d));
   for (q = 0; q < size * size; q++)
+    if (s[q / size][q % size] != latin[q / size][q % size])
+      d.w[q / 64] |= 1ULL << (q % 64);
+  for (j = 0; j < cellwords && !d.w[j]; j++)
+    ;
+  if (j == cellwords)
+    return;
+  for (i = 0; i < witnesses; i++)
     {
-      if (s[q / size][q % size])
-	{
-	  int tmp = s[q / size][q % size], x;
-	  struct bitmap ret;
-	  s[q / size][q % size] = 0;
-	  x = fill2 (s, cs - 1, 0, size);
-	  ret = testone (s, q / size, q % size, size);
-
-	  if (x == 1 && ret.count < retmin)
-	    {
-	      retmin = ret.count;
-	      badflag = q;
-	    }
-
-	  s[q / size][q % size] = tmp;
-	}
-    }
-  if (badflag != -1)
-    {
-      s[badflag / size][badflag % size] = 0;
-      recursemin (s, cs - 1, size, ic);
+      for (j = 0; j < cellwords; j++)
+	if (witness[i].w[j] & ~d.w[j])
+	  break;
+      if (j == cellwords)
+	return;
     }
-  else
+  if (witnesses == maxwitnesses)
     {
-      {
-	print (s, size);
-	printf ("%d:%d\n", ic, cs);
-	fflush (stdout); 
-      }
+      maxwitnesses = maxwitnesses ? 2 * maxwitnesses : 64;
+      witness = realloc (witness, maxwitnesses * sizeof (struct cells));
+      if (!witness)
+	{
+	  printf ("realloc failed\n");
+	  exit (1);
+	}
     }
+  witness[witnesses++] = d;
 }
 
-void
-recursemax (int s[SIZE][SIZE], int cs, int size, int ic)
+int
+witnessed (struct cells *p, int q)
 {
-  /* same as recurse(), except remove entry where ret.count is biggest */
-  int q, badflag = -1;
-  int retmax = -1;
-  if (cs < minsize)
-    return;
-  for (q = 0; q < size * size; q++)
+  /* nonzero if some witness meets the filled cells p only in cell q,
+     so that emptying q leaves two completions */
+  int i, j, qw = q / 64;
+  unsigned long long qb = 1ULL << (q % 64);
+  for (i = 0; i < witnesses; i++)
     {
-      if (s[q / size][q % size])
+      if (!(witness[i].w[qw] & qb))
+	continue;
+      for (j = 0; j < cellwords; j++)
+	if ((witness[i].w[j] & p->w[j]) != (j == qw ? qb : 0))
+	  break;
+      if (j == cellwords)
 	{
-	  int tmp = s[q / size][q % size], x;
-	  struct bitmap ret;
-	  s[q / size][q % size] = 0;
-	  x = fill2 (s, cs - 1, 0, size);
-	  ret = testone (s, q / size, q % size, size);
-
-	  if (x == 1 && ret.count > retmax)
-	    {
-	      retmax = ret.count;
-	      badflag = q;
-	    }
-
-	  s[q / size][q % size] = tmp;
+	  STAT (witness_hits, 0);
+	  return 1;
 	}
     }
-  if (badflag != -1)
-    {
-      s[badflag / size][badflag % size] = 0;
-      recursemax (s, cs - 1, size, ic);
-    }
-  else
-    {
-      {
-	print (s, size);
-	printf ("%d:%d\n", ic, cs);
-	fflush (stdout); 
-      }
-    }
+  return 0;
 }
 
+void
+report (entry s[SIZE][SIZE], int size, int ic, int cs)
+{
+  /* print a critical set of size cs found in a square with ic
+     intercalates, one thread at a time */
+  pthread_mutex_lock (&outlock);
+  if (cs > max)
+    max = cs;
+  print (s, size);
+  printf ("%d:%d\n", ic, cs);
+  fflush (stdout);
+  pthread_mutex_unlock (&outlock);
+}
 
 void
-recursernd (int s[SIZE][SIZE], int cs, int size, int ic)
+widen (entry s[SIZE][SIZE], int *t, int size)
 {
-  /* same as recurse(), except remove entries randomly */
-  int t[SIZE * SIZE], count = 0, q, badflag = 0;
-  if (cs < minsize)
-    return;
-  memset (t, 0, sizeof (t));
-  for (q = 0; q < size * size; q++)
-    {
-      if (s[q / size][q % size])
-	{
-	  int tmp = s[q / size][q % size], x;
-	  s[q / size][q % size] = 0;
-	  if (fill2 (s, cs - 1, 0, size) == 1)
-	    {
-	      badflag = 1;
-	      t[count++] = q;
-	    }
-	  s[q / size][q % size] = tmp;
-	}
-    }
-  if (badflag)
-    {
-      int rand1;
-      rand1 = random () % count;
-      s[t[rand1] / size][t[rand1] % size] = 0;
+  /* copy s into t, size ints to a row, as dlx.c and sqfile.c use */
+  int r, c;
+  for (r = 0; r < size; r++)
+    for (c = 0; c < size; c++)
+      t[r * size + c] = s[r][c];
+}
 
-      recursernd (s, cs - 1, size, ic);
-    }
-  else
-    {
-      print (s, size);
-      printf ("%d:%d\n", ic, cs);
-    }
+void
+narrow (int *t, entry s[SIZE][SIZE], int size)
+{
+  /* the reverse of widen() */
+  int r, c;
+  for (r = 0; r < size; r++)
+    for (c = 0; c < size; c++)
+      s[r][c] = t[r * size + c];
 }
 
+long
+dlxsquare (struct dlx *d, entry s[SIZE][SIZE], long cap, dlx_visit visit)
+{
+  /* dlx_complete() for a square of ours */
+  int t[SIZE * SIZE];
+  widen (s, t, order);
+  return dlx_complete (d, t, cap, visit, NULL);
+}
 
-int
-fill2 (int s[SIZE][SIZE], int level, int pos, int size)
-{
-  /* this function attempts to complete the 
-     partial Latin square supplied in the array s.
-     During the forcing process, if no element could
-     possibly *be* in a position, then there
-     is no point in continuing.  The function
-     returns the number of possible Latin squares
-     based on the given square.  */
-  struct bitmap ret;
-  int a = 0, b = 0, c, poss = 0;
-  int min, minx, miny;
-  /* go through each element in the Latin square */
-  /* and test whether that element has a forced */
-  /* completion. if not, move on to semi-strong */
-
-  /* are we already finished? */
-  if (level == size * size)
-    return 1;
+static int
+dlxwitness (int *sq, void *arg)
+{
+  /* each completion found by dlxfill2 */
+  entry s[SIZE][SIZE];
+  narrow (sq, s, order);
+  addwitness (s, order);
+  return 0;
+}
 
-  /* try strong completion, then semistrong, then critical */
-  /* now try all possibilities */
-  min = size * size;
-  a = b = 0;
-  while (b * size + a < size * size)
-    {
-      if (!s[b][a])
-	{
-	  ret = testone (s, b, a, size);
-	  if (ret.count == 0)
-	    return 0;
-	  if (min > ret.count)
-	    {
-	      minx = b;
-	      miny = a;
-	      min = ret.count;
-	    }
-	}
-      a++;
-      if (a == size)
-	{
-	  b++;
-	  a = 0;
-	}
-    }
-  b = minx;
-  a = miny;
-  ret = testone (s, b, a, size);
-  for (c = 1; c <= size; c++)
-    {
-      if (ret.values[c])
-	{
-	  s[b][a] = c;
-	  poss += fill2 (s, level + 1, b * size + a + 1, size);
-	  s[b][a] = 0;
-	}
-      /* return immediately if > 1 */
-      if (poss > 1)
-	return poss;
-    }
-  /* if one square fails,
-     forget about the rest */
-  return poss;
+static int
+dlxleaf (int *sq, void *arg)
+{
+  /* each completion found by dlxfill; the engine owns sq */
+  entry s[SIZE][SIZE];
+  narrow (sq, s, order);
+  initused (s, order);
+  reduce (s, order, -1);
+  return 0;
+}
+
+/* the kernels, for orders 5 to 12 and (ORDER 0) any other */
+#define ORDER 0
+#include "kernels.h"
+#define ORDER 5
+#include "kernels.h"
+#define ORDER 6
+#include "kernels.h"
+#define ORDER 7
+#include "kernels.h"
+#define ORDER 8
+#include "kernels.h"
+#define ORDER 9
+#include "kernels.h"
+#define ORDER 10
+#include "kernels.h"
+#define ORDER 11
+#include "kernels.h"
+#define ORDER 12
+#include "kernels.h"
+
+static const struct kernels *const kernelsfor[] = {
+  NULL, NULL, NULL, NULL, NULL, &kernels_5, &kernels_6, &kernels_7,
+  &kernels_8, &kernels_9, &kernels_10, &kernels_11, &kernels_12
+};
+
+const struct kernels *
+kernelsof (int size)
+{
+  /* the kernels for squares of order size */
+  if (size < sizeof (kernelsfor) / sizeof (kernelsfor[0]) && kernelsfor[size])
+    return kernelsfor[size];
+  return &kernels_0;
 }
 
 void
@@ -465,71 +769,1348 @@ display (int array[200][200])
 }
 
 
-int
-fill (int s[SIZE][SIZE], int level, int pos, int size)
-{
-  /* this function attempts to complete the
-     partial Latin square supplied in the array s.
-     During the forcing process, if no element could
-     possibly *be* in a position, then there
-     is no point in continuing.  The function
-     returns the number of possible Latin squares
-     based on the given square.  */
-  struct bitmap ret;
-  int a = 0, b = 0, c, changed, mod = 1, mod1 = 1, mod2 = 1, poss = 0, xb = 0;
-  if (level == size * size)
+/* Main class reduction (-s).  Every candidate form of a square is
+   built the same way: take one of its six conjugates, an ordered pair
+   of rows a, b and an ordering of the columns that lists the cycles
+   of the permutation taking row b to row a one after another, shortest
+   first.  Renaming the symbols so that row a reads 1..n and sorting the
+   rows by their first symbol gives a reduced square.  Only pairs whose
+   cycle structure has the fewest orderings (then the fewest cycles)
+   are tried; that choice is the same for every square of a main class,
+   so the smallest form is a main class invariant.  A square is kept
+   when it is itself that smallest form; with useflag 2 the smallest
+   form is generally not enumerated, so the forms already seen are kept
+   in a hash set instead. */
+
+struct
+{
+  int n, len, used;
+  unsigned char *key;
+  pthread_mutex_t lock;
+} seen = { 0, 0, 0, NULL, PTHREAD_MUTEX_INITIALIZER };
+
+struct canon
+{
+  int size, stop, less, equal;
+  unsigned char (*m)[SIZE];	/* the conjugate being tried */
+  unsigned char rowof[SIZE][SIZE];	/* rowof[c][v]: row with v in column c */
+  unsigned char (*best)[SIZE];
+  int a, col[SIZE], next[SIZE], start[SIZE], len[SIZE], cycles;
+  int slot[SIZE];		/* lengths wanted, shortest first */
+  char taken[SIZE];
+};
+
+static int
+cycletype (struct canon *k, int a, int b, long *orderings)
+{
+  /* split the columns into the cycles of j -> column of m[b][j] in
+     row a; returns the number of cycles, with k->len[] sorted */
+  int pos[SIZE], j, i, n = 0, l, size = k->size, mult;
+  char done[SIZE];
+  for (j = 0; j < size; j++)
     {
+      pos[k->m[a][j]] = j;
+      done[j] = 0;
+    }
+  for (j = 0; j < size; j++)
+    k->next[j] = pos[k->m[b][j]];
+  for (j = 0; j < size; j++)
+    if (!done[j])
       {
-	int s2[SIZE][SIZE];
-	count++;
-	memcpy (s2, s, sizeof (int) * SIZE * SIZE);
-	if (icount (s, size) >= mininter)
+	k->start[n] = j;
+	for (l = 0, i = j; !done[i]; i = k->next[i], l++)
+	  done[i] = 1;
+	for (i = n; i > 0 && k->len[i - 1] > l; i--)
 	  {
-	    if (recflag == 0)
-	      recurse (s, size * size, size, icount (s, size));
-	    if (recflag == 1)
-	      recursemax (s, size * size, size, icount (s, size));
-	    if (recflag == 2)
-	      recursemin (s, size * size, size, icount (s, size));
-	    if (recflag == 3)
-	      recursernd (s, size * size, size, icount (s, size));
+	    k->len[i] = k->len[i - 1];
+	    k->start[i] = k->start[i - 1];
 	  }
-	memcpy (s, s2, sizeof (int) * SIZE * SIZE);
-	/* if (array[icount(s,size)][0]==0)
-	   {
-	   array[icount(s,size)][0] = 1;
-	   printf("%d %d\n",count,icount(s,size));
-	   } */
-	return 1;
+	k->len[i] = l;
+	k->start[i] = j;
+	n++;
       }
+  *orderings = 1;
+  for (i = 0, mult = 0; i < n; i++)
+    {
+      mult = i && k->len[i] == k->len[i - 1] ? mult + 1 : 1;
+      *orderings *= k->len[i] * mult;
     }
-  /* try strong completion, then semistrong, then critical */
-  /* now try all possibilities */
-  a = pos % size;
-  b = pos / size;
-  while (s[b][a])
+  return n;
+}
+
+static int
+cmplen (int *x, int nx, int *y, int ny)
+{
+  /* order cycle structures by number of cycles, then by length */
+  int i;
+  if (nx != ny)
+    return nx - ny;
+  for (i = 0; i < nx; i++)
+    if (x[i] != y[i])
+      return x[i] - y[i];
+  return 0;
+}
+
+static int
+candidate (struct canon *k)
+{
+  /* compare the form given by k->col[] with k->best, replacing it if
+     smaller; returns 1 if it is smaller and k->stop is set */
+  int gamma[SIZE], x, i, r, size = k->size, v;
+  for (i = 0; i < size; i++)
+    gamma[k->m[k->a][k->col[i]]] = i;
+  k->less = 0;
+  for (x = 0; x < size; x++)
     {
-      a++;
-      if (a == size)
+      r = k->rowof[k->col[0]][k->m[k->a][k->col[x]]];
+      for (i = 0; i < size; i++)
 	{
-	  b++;
-	  a = 0;
+	  v = gamma[k->m[r][k->col[i]]];
+	  if (!k->less)
+	    {
+	      if (v > k->best[x][i])
+		return 0;
+	      if (v < k->best[x][i])
+		{
+		  if (k->stop)
+		    return 1;
+		  k->less = 1;
+		}
+	    }
+	  k->best[x][i] = v;
 	}
     }
+  if (!k->less)
+    k->equal = 1;
+  return 0;
+}
+
+static int
+orderings (struct canon *k, int slot, int used)
+{
+  /* lay the cycles out in every allowed order, trying each form */
+  int c, j, i, l;
+  if (slot == k->cycles)
+    return candidate (k);
+  for (c = 0; c < k->cycles; c++)
+    if (!k->taken[c] && k->len[c] == k->slot[slot])
+      {
+	k->taken[c] = 1;
+	for (j = k->start[c], l = 0; l < k->len[c]; l++, j = k->next[j])
+	  {
+	    for (i = 0; i < k->len[c]; i++, j = k->next[j])
+	      k->col[used + i] = j;
+	    if (orderings (k, slot + 1, used + k->len[c]))
+	      return 1;
+	  }
+	k->taken[c] = 0;
+      }
+  return 0;
+}
+
+int
+canonical (entry s[SIZE][SIZE], int size, unsigned char best[SIZE][SIZE],
+	   int stop)
+{
+  /* with stop set, best holds s (symbols 0..size-1) and the result is
+     1 if s is its own smallest form, 0 as soon as a smaller one turns
+     up; otherwise best is set to the smallest form and the result is 1 */
+  static const int perm[6][3] = { {0, 1, 2}, {1, 0, 2}, {0, 2, 1},
+  {2, 0, 1}, {1, 2, 0}, {2, 1, 0}
+  };
+  unsigned char m[6][SIZE][SIZE];
+  struct canon k;
+  int p, a, b, r, c, t[3], n, fewest[SIZE], nfewest = 0, cmp, i;
+  int pair[6 * SIZE * SIZE], pairs = 0;
+  long ord, bestord = -1;
+
+  k.size = size;
+  k.stop = stop;
+  k.equal = 0;
+  k.best = best;
+  if (!stop)
+    memset (best, 0xff, SIZE * SIZE);
+  for (p = 0; p < 6; p++)
+    for (r = 0; r < size; r++)
+      for (c = 0; c < size; c++)
+	{
+	  t[0] = r;
+	  t[1] = c;
+	  t[2] = s[r][c] - 1;
+	  m[p][t[perm[p][0]]][t[perm[p][1]]] = t[perm[p][2]];
+	}
 
+  /* find the cycle structure to use and the row pairs that have it */
+  for (p = 0; p < 6; p++)
+    {
+      k.m = m[p];
+      for (a = 0; a < size; a++)
+	for (b = 0; b < size; b++)
+	  {
+	    if (a == b)
+	      continue;
+	    n = cycletype (&k, a, b, &ord);
+	    if (bestord >= 0 && ord > bestord)
+	      continue;
+	    cmp = bestord < 0 || ord < bestord ? -1
+	      : cmplen (k.len, n, fewest, nfewest);
+	    if (cmp < 0)
+	      {
+		bestord = ord;
+		nfewest = n;
+		memcpy (fewest, k.len, n * sizeof (int));
+		pairs = 0;
+	      }
+	    if (cmp <= 0)
+	      pair[pairs++] = (p * SIZE + a) * SIZE + b;
+	  }
+    }
 
-  ret = testone (s, b, a, size);
-  for (c = 1; c <= size; c++)
+  /* then try every form they give */
+  for (i = 0, p = -1; i < pairs; i++)
     {
-      if (ret.values[c])
+      if (pair[i] / SIZE / SIZE != p)
 	{
-	  s[b][a] = c;
-	  fill (s, level + 1, b * size + a + 1, size);
-	  s[b][a] = 0;
+	  p = pair[i] / SIZE / SIZE;
+	  k.m = m[p];
+	  for (r = 0; r < size; r++)
+	    for (c = 0; c < size; c++)
+	      k.rowof[c][m[p][r][c]] = r;
 	}
-      /* return immediately if > 1 */
+      k.a = pair[i] / SIZE % SIZE;
+      k.cycles = cycletype (&k, k.a, pair[i] % SIZE, &ord);
+      memcpy (k.slot, k.len, k.cycles * sizeof (int));
+      memset (k.taken, 0, sizeof (k.taken));
+      if (orderings (&k, 0, 0))
+	return 0;
     }
-  /* if one square fails,
-     forget about the rest */
-  return 0;
+  return stop ? k.equal : 1;
+}
+
+void
+initseen (int size)
+{
+  /* keep the forms seen, rather than expecting the smallest */
+  seen.n = 1024;
+  seen.key = calloc (seen.n, size * size + 1);
+  if (!seen.key)
+    {
+      printf ("calloc failed\n");
+      exit (1);
+    }
+}
+
+int
+newclass (entry s[SIZE][SIZE], int size)
+{
+  /* nonzero if s is the first square seen from its main class */
+  unsigned char form[SIZE][SIZE], *key;
+  unsigned long h = 5381;
+  int r, c, i, len = size * size, found = 0;
+
+  if (!seen.key)
+    {
+      for (r = 0; r < size; r++)
+	for (c = 0; c < size; c++)
+	  form[r][c] = s[r][c] - 1;
+      return canonical (s, size, form, 1);
+    }
+  canonical (s, size, form, 0);
+  for (r = 0; r < size; r++)
+    for (c = 0; c < size; c++)
+      h = h * 33 + form[r][c];
+
+  pthread_mutex_lock (&seen.lock);
+  if (2 * (seen.used + 1) > seen.n)
+    {
+      /* grow and rehash */
+      unsigned char *old = seen.key;
+      int oldn = seen.n;
+      seen.n *= 2;
+      seen.key = calloc ((long) seen.n, len + 1);
+      if (!seen.key)
+	{
+	  printf ("calloc failed\n");
+	  exit (1);
+	}
+      for (i = 0; i < oldn; i++)
+	if (old[(long) i * (len + 1)])
+	  {
+	    unsigned long g = 5381;
+	    unsigned char *o = old + (long) i * (len + 1) + 1;
+	    for (r = 0; r < len; r++)
+	      g = g * 33 + o[r];
+	    for (g %= seen.n; seen.key[g * (len + 1)]; g = (g + 1) % seen.n)
+	      ;
+	    memcpy (seen.key + g * (len + 1), o - 1, len + 1);
+	  }
+      free (old);
+    }
+  for (h %= seen.n;; h = (h + 1) % seen.n)
+    {
+      key = seen.key + h * (len + 1);
+      if (!key[0])
+	{
+	  key[0] = 1;
+	  for (r = 0; r < size; r++)
+	    memcpy (key + 1 + r * size, form[r], size);
+	  seen.used++;
+	  found = 1;
+	  break;
+	}
+      for (r = 0; r < size; r++)
+	if (memcmp (key + 1 + r * size, form[r], size))
+	  break;
+      if (r == size)
+	break;
+    }
+  pthread_mutex_unlock (&seen.lock);
+  return found;
+}
+
+void
+reduce (entry s[SIZE][SIZE], int size, int ic)
+{
+  /* look for a critical set inside the complete square s, with ic
+     intercalates (counted here if ic < 0), which is left as it was
+     found.  Only squares with mininter intercalates are counted, since
+     fill() never completes the others but Dancing Links does. */
+  entry s2[SIZE][SIZE];
+  if (ic < 0)
+    ic = kern->icount (s);
+  if (ic < mininter)
+    return;
+  count++;
+  if (symflag && !newclass (s, size))
+    return;
+  memcpy (s2, s, size * sizeof (s2[0]));
+  memcpy (latin, s, size * sizeof (latin[0]));
+  witnesses = 0;
+  if (recflag < 4)
+    kern->recurse[recflag] (s, size * size, ic);
+  else
+    localsearch (s, size, ic);
+  memcpy (s, s2, size * sizeof (s2[0]));
+  initused (s, size);
+  /* if (array[icount(s,size)][0]==0)
+     {
+     array[icount(s,size)][0] = 1;
+     printf("%d %d\n",count,icount(s,size));
+     } */
+}
+
+/* Parallel search.  split() walks the top of the fill() tree, visiting
+   cells in the same order, and keeps each prefix of the given depth as
+   the list of symbols placed.  The prefixes are dealt out in blocks to
+   one deque per thread; a thread takes work from the bottom of its own
+   deque and, when that is empty, steals from the top of another. */
+
+struct deque
+{
+  pthread_mutex_t lock;
+  int top, bottom;		/* tasks order[top..bottom-1] are left */
+};
+
+struct
+{
+  entry s[SIZE][SIZE];
+  int level, size, depth, threads;
+  int tasks, maxtasks;
+  unsigned char *path;		/* depth symbols per task */
+  int *order;
+  struct deque *deque;
+  int saved;			/* tasks in the checkpoint read */
+  char *done;			/* tasks finished */
+  time_t cktime;		/* when the last checkpoint was written */
+} work;
+
+void
+split (entry s[SIZE][SIZE], int level, int pos, int size, int depth,
+       unsigned char *path)
+{
+  unsigned int ret;
+  int a, b, c;
+  if (depth == work.depth)
+    {
+      if (work.tasks == work.maxtasks)
+	{
+	  work.maxtasks = work.maxtasks ? 2 * work.maxtasks : 1024;
+	  work.path = realloc (work.path, work.maxtasks * work.depth);
+	  if (!work.path)
+	    {
+	      printf ("realloc failed\n");
+	      exit (1);
+	    }
+	}
+      memcpy (work.path + work.tasks++ * work.depth, path, work.depth);
+      return;
+    }
+  a = pos % size;
+  b = pos / size;
+  while (s[b][a])
+    {
+      a++;
+      if (a == size)
+	{
+	  b++;
+	  a = 0;
+	}
+    }
+  for (ret = testone (b, a, level); ret; ret &= ret - 1)
+    {
+      c = __builtin_ctz (ret);
+      path[depth] = c;
+      setcell (s, b, a, c);
+      split (s, level + 1, b * size + a + 1, size, depth + 1, path);
+      clearcell (s, b, a);
+    }
+}
+
+int
+nexttask (int me)
+{
+  /* the next task for thread me, or -1 when there are none left */
+  int i, t = -1;
+  struct deque *d = &work.deque[me];
+  pthread_mutex_lock (&d->lock);
+  if (d->bottom > d->top)
+    t = work.order[--d->bottom];
+  pthread_mutex_unlock (&d->lock);
+  for (i = 1; t < 0 && i < work.threads; i++)
+    {
+      d = &work.deque[(me + i) % work.threads];
+      pthread_mutex_lock (&d->lock);
+      if (d->bottom > d->top)
+	t = work.order[d->top++];
+      pthread_mutex_unlock (&d->lock);
+    }
+  return t;
+}
+
+int
+replay (int t, entry s[SIZE][SIZE])
+{
+  /* set s up as the square at the root of task t; returns the
+     position fill() carries on from */
+  int i, a, b, pos = 0, size = work.size;
+  unsigned char *path = work.path + t * work.depth;
+  memcpy (s, work.s, sizeof (work.s));
+  initused (s, size);
+  for (i = 0; i < work.depth; i++)
+    {
+      while (s[pos / size][pos % size])
+	pos++;
+      b = pos / size;
+      a = pos % size;
+      setcell (s, b, a, path[i]);
+      pos++;
+    }
+  initic (s, size);
+  return pos;
+}
+
+void
+runtask (int t)
+{
+  /* replay the prefix of task t, then fill() the rest */
+  entry s[SIZE][SIZE];
+  int pos = replay (t, s);
+  kern->fill (s, work.level + work.depth, pos);
+}
+
+/* Checkpoints.  The task list depends only on the arguments, so a
+   checkpoint is the arguments, the depth of the cut, the squares and
+   largest critical set so far and a bitmap of the finished tasks.
+   Tasks that were running when the checkpoint was written are run
+   again on resuming, and their critical sets reported again; so are
+   main classes seen before, with -s and useflag 2. */
+
+#define CKINTERVAL 60		/* seconds between checkpoints */
+
+void
+savecheckpoint (void)
+{
+  /* write the checkpoint to a new file, then rename it over the old
+     one; called with outlock held */
+  char tmp[1024];
+  FILE *f;
+  int i, j, x;
+  snprintf (tmp, sizeof (tmp), "%s.tmp", ckfile);
+  if ((f = fopen (tmp, "w")) == NULL)
+    {
+      printf ("failed to open %s\n", tmp);
+      return;
+    }
+  fprintf (f, "find-lcs checkpoint\n%d %d %d %d %d %d\n%d %d\n%ld %d\n",
+	   work.size, minsize, mininter, use, recflag, symflag,
+	   work.depth, work.tasks, squares, max);
+  for (i = 0; i < work.tasks; i += 4)
+    {
+      for (x = j = 0; j < 4 && i + j < work.tasks; j++)
+	x |= work.done[i + j] << j;
+      fputc ("0123456789abcdef"[x], f);
+    }
+  fputc ('\n', f);
+  if (fclose (f) || rename (tmp, ckfile))
+    printf ("failed to write %s\n", ckfile);
+  work.cktime = time (NULL);
+}
+
+void
+loadcheckpoint (char *file, int size)
+{
+  /* set up work to carry on from the checkpoint in file */
+  FILE *f;
+  int a[6], i, j, c;
+  if ((f = fopen (file, "r")) == NULL)
+    {
+      printf ("failed to open %s\n", file);
+      exit (1);
+    }
+  if (fscanf (f, "find-lcs checkpoint %d %d %d %d %d %d %d %d %ld %d",
+	      &a[0], &a[1], &a[2], &a[3], &a[4], &a[5], &work.depth,
+	      &work.saved, &squares, &max) != 10
+      || a[0] != size || a[1] != minsize || a[2] != mininter
+      || a[3] != use || a[4] != recflag || a[5] != symflag)
+    {
+      printf ("%s is not a checkpoint of this search\n", file);
+      exit (1);
+    }
+  work.done = calloc (work.saved + 4, 1);
+  if (!work.done)
+    {
+      printf ("calloc failed\n");
+      exit (1);
+    }
+  while ((c = fgetc (f)) != EOF && c != '\n')
+    ;
+  for (i = 0; i < work.saved; i += 4)
+    {
+      c = fgetc (f);
+      c = c >= 'a' ? c - 'a' + 10 : c - '0';
+      if (c < 0 || c > 15)
+	{
+	  printf ("%s is truncated\n", file);
+	  exit (1);
+	}
+      for (j = 0; j < 4; j++)
+	work.done[i + j] = c >> j & 1;
+    }
+  fclose (f);
+}
+
+void *
+worker (void *arg)
+{
+  int me = (int) (long) arg, t;
+  if (usedlx)
+    {
+      dlxfill = dlx_new (work.size, work.size);
+      dlxfill2 = dlx_new (work.size, work.size);
+    }
+  while ((t = nexttask (me)) >= 0)
+    {
+      runtask (t);
+      if (ckfile)
+	{
+	  pthread_mutex_lock (&outlock);
+	  squares += count;
+	  count = 0;
+	  work.done[t] = 1;
+	  if (time (NULL) - work.cktime >= CKINTERVAL)
+	    savecheckpoint ();
+	  pthread_mutex_unlock (&outlock);
+	}
+    }
+  pthread_mutex_lock (&outlock);
+  squares += count;
+  pthread_mutex_unlock (&outlock);
+  dlx_free (dlxfill);
+  dlx_free (dlxfill2);
+  free (witness);
+  return NULL;
+}
+
+void
+cut (entry s[SIZE][SIZE], int level, int size, int want)
+{
+  /* split s at the shallowest depth giving at least want tasks */
+  unsigned char path[SIZE * SIZE];
+  for (work.depth = 1;; work.depth++)
+    {
+      free (work.path);
+      work.path = NULL;
+      work.tasks = work.maxtasks = 0;
+      split (s, level, 0, size, 0, path);
+      if (work.tasks >= want || work.depth == size * size - level)
+	break;
+    }
+}
+
+void
+parallel (entry s[SIZE][SIZE], int level, int size, int threads)
+{
+  /* fill() the partial square s with the given number of threads */
+  unsigned char path[SIZE * SIZE];
+  pthread_t *tid;
+  int i, left = 0;
+
+  memcpy (work.s, s, sizeof (work.s));
+  work.level = level;
+  work.size = size;
+  work.threads = threads;
+
+  if (work.done)
+    {
+      /* resuming, or one shard: cut where the checkpoint or the
+         manifest did */
+      split (s, level, 0, size, 0, path);
+      if (work.tasks != work.saved)
+	{
+	  printf ("checkpoint has %d tasks, not %d\n", work.saved,
+		  work.tasks);
+	  exit (1);
+	}
+    }
+  else
+    /* cut deep enough for plenty of tasks per thread */
+    cut (s, level, size, 64 * threads);
+  if (ckfile && !work.done)
+    work.done = calloc (work.tasks + 4, 1);
+
+  work.order = malloc (work.tasks * sizeof (int));
+  work.deque = malloc (threads * sizeof (struct deque));
+  tid = malloc (threads * sizeof (pthread_t));
+  if (!work.order || !work.deque || !tid)
+    {
+      printf ("malloc failed\n");
+      exit (1);
+    }
+  for (i = work.tasks - 1; i >= 0; i--)
+    if (!work.done || !work.done[i])
+      work.order[left++] = i;	/* pop in fill() order */
+  for (i = 0; i < threads; i++)
+    {
+      pthread_mutex_init (&work.deque[i].lock, NULL);
+      work.deque[i].top = (long) left * i / threads;
+      work.deque[i].bottom = (long) left * (i + 1) / threads;
+    }
+  work.cktime = time (NULL);
+  for (i = 0; i < threads; i++)
+    pthread_create (&tid[i], NULL, worker, (void *) (long) i);
+  for (i = 0; i < threads; i++)
+    pthread_join (tid[i], NULL);
+  if (ckfile)
+    savecheckpoint ();
+  free (work.done);
+  free (tid);
+  free (work.deque);
+  free (work.order);
+  free (work.path);
+}
+
+/* Manifests.  --manifest FILE writes the tasks of a search (see -j),
+   cut at --depth or deep enough for MANIFESTTASKS of them, to FILE
+   with the work each is likely to be, from MANIFESTPROBES random dives
+   down its fill() tree.  The dives are seeded by task, so the same
+   arguments give the same manifest.  --shard i/N with --manifest FILE
+   runs shard i of N: the tasks are dealt out largest first, each to
+   the shard with the least work so far, and those of the other shards
+   are treated as done.  The shard ends its output with a summary line,
+   starting with # so that the output can still be read by -f and -v,
+   and --merge adds up those lines. */
+
+#define MANIFESTTASKS 4096
+#define MANIFESTPROBES 16
+
+void
+writemanifest (char *file, entry s[SIZE][SIZE], int level, int size,
+	       int depth)
+{
+  entry t[SIZE][SIZE];
+  unsigned char path[SIZE * SIZE];
+  FILE *f;
+  double est;
+  int i, j, pos;
+
+  memcpy (work.s, s, sizeof (work.s));
+  work.level = level;
+  work.size = size;
+  if (depth)
+    {
+      work.depth = depth < size * size - level ? depth : size * size - level;
+      split (s, level, 0, size, 0, path);
+    }
+  else
+    cut (s, level, size, MANIFESTTASKS);
+  if ((f = fopen (file, "w")) == NULL)
+    {
+      printf ("failed to open %s\n", file);
+      exit (1);
+    }
+  fprintf (f, "find-lcs manifest\n%d %d %d %d %d %d\n%d %d\n",
+	   size, minsize, mininter, use, recflag, symflag, work.depth,
+	   work.tasks);
+  for (i = 0; i < work.tasks; i++)
+    {
+      pos = replay (i, t);
+      rndstate = i;
+      for (est = j = 0; j < MANIFESTPROBES; j++)
+	est += kern->probe (t, level + work.depth, pos);
+      fprintf (f, "%.0f", est / MANIFESTPROBES);
+      for (j = 0; j < work.depth; j++)
+	fprintf (f, " %d", work.path[i * work.depth + j]);
+      fputc ('\n', f);
+    }
+  if (fclose (f))
+    {
+      printf ("failed to write %s\n", file);
+      exit (1);
+    }
+  printf ("%d tasks at depth %d written to %s\n", work.tasks, work.depth,
+	  file);
+  free (work.path);
+}
+
+struct task
+{
+  double cost;
+  int t;
+};
+
+static int
+bycost (const void *x, const void *y)
+{
+  const struct task *a = x, *b = y;
+  if (a->cost != b->cost)
+    return a->cost < b->cost ? 1 : -1;
+  return a->t - b->t;
+}
+
+void
+loadmanifest (char *file, entry s[SIZE][SIZE], int level, int size)
+{
+  /* mark the tasks of the other shards done, checking that the
+     manifest is for this search */
+  unsigned char path[SIZE * SIZE];
+  struct task *task;
+  double *load;
+  FILE *f;
+  int a[6], depth, tasks, i, j, k, v, ok;
+
+  if ((f = fopen (file, "r")) == NULL)
+    {
+      printf ("failed to open %s\n", file);
+      exit (1);
+    }
+  if (fscanf (f, "find-lcs manifest %d %d %d %d %d %d %d %d", &a[0],
+	      &a[1], &a[2], &a[3], &a[4], &a[5], &depth, &tasks) != 8
+      || a[0] != size || a[1] != minsize || a[2] != mininter
+      || a[3] != use || a[4] != recflag || a[5] != symflag
+      || (work.done && depth != work.depth))
+    {
+      printf ("%s is not a manifest of this search\n", file);
+      exit (1);
+    }
+  memcpy (work.s, s, sizeof (work.s));
+  work.level = level;
+  work.size = size;
+  work.depth = depth;
+  split (s, level, 0, size, 0, path);
+  task = malloc (tasks * sizeof (struct task));
+  load = calloc (shards, sizeof (double));
+  if (!task || !load)
+    {
+      printf ("malloc failed\n");
+      exit (1);
+    }
+  for (ok = work.tasks == tasks, i = 0; ok && i < tasks; i++)
+    {
+      task[i].t = i;
+      ok = fscanf (f, "%lf", &task[i].cost) == 1;
+      for (j = 0; ok && j < depth; j++)
+	ok = fscanf (f, "%d", &v) == 1 && v == work.path[i * depth + j];
+    }
+  fclose (f);
+  if (!ok)
+    {
+      printf ("%s does not match the tasks of this search\n", file);
+      exit (1);
+    }
+
+  /* deal the tasks out, the most work first */
+  qsort (task, tasks, sizeof (struct task), bycost);
+  if (!work.done)
+    work.done = calloc (tasks + 4, 1);
+  if (!work.done)
+    {
+      printf ("calloc failed\n");
+      exit (1);
+    }
+  for (i = 0; i < tasks; i++)
+    {
+      for (k = 0, j = 1; j < shards; j++)
+	if (load[j] < load[k])
+	  k = j;
+      load[k] += task[i].cost;
+      if (k != shard - 1)
+	work.done[task[i].t] = 1;
+    }
+  work.saved = tasks;
+  free (work.path);
+  work.path = NULL;
+  work.tasks = work.maxtasks = 0;
+  free (task);
+  free (load);
+}
+
+int
+mergeshards (int n, char **names)
+{
+  /* copy the outputs of the shards named to stdout, then add up their
+     summary lines; returns 1 unless each shard is there just once.  The
+     output of a shard is held back until its summary line, which comes
+     last, shows it is wanted. */
+  char line[4096], *seen = NULL;
+  FILE *f, *held;
+  int i, a, b, m, of = 0, best = 0, got = 0, bad = 0;
+  long sq, total = 0, kept;
+  size_t k;
+
+  if ((held = tmpfile ()) == NULL)
+    {
+      printf ("failed to make a temporary file\n");
+      return 1;
+    }
+  for (i = 0; i < n; i++)
+    {
+      if ((f = fopen (names[i], "r")) == NULL)
+	{
+	  printf ("failed to open %s\n", names[i]);
+	  return 1;
+	}
+      rewind (held);
+      kept = 0;
+      while (fgets (line, sizeof (line), f))
+	{
+	  if (sscanf (line,
+		      "# shard %d/%d: %ld squares reduced, largest critical set %d",
+		      &a, &b, &sq, &m) != 4)
+	    {
+	      fputs (line, held);
+	      kept += strlen (line);
+	      continue;
+	    }
+	  if (!seen)
+	    {
+	      of = b;
+	      seen = calloc (of + 1, 1);
+	    }
+	  rewind (held);
+	  if (!seen || b != of || a < 1 || a > of || seen[a])
+	    {
+	      printf ("# %s: shard %d/%d is not wanted\n", names[i], a, b);
+	      bad = 1;
+	      kept = 0;
+	      continue;
+	    }
+	  for (; kept > 0; kept -= k)
+	    {
+	      k = fread (line, 1, kept < (long) sizeof (line) ?
+			 kept : sizeof (line), held);
+	      if (!k)
+		break;
+	      fwrite (line, 1, k, stdout);
+	    }
+	  rewind (held);
+	  kept = 0;
+	  seen[a] = 1;
+	  got++;
+	  total += sq;
+	  if (m > best)
+	    best = m;
+	}
+      fclose (f);
+      if (kept)
+	{
+	  printf ("# %s: no shard summary at the end, output left out\n",
+		  names[i]);
+	  bad = 1;
+	}
+    }
+  fclose (held);
+  printf ("# merged %d of %d shards: %ld squares reduced, "
+	  "largest critical set %d\n", got, of, total, best);
+  if (got < of)
+    {
+      printf ("# missing shards:");
+      for (a = 1; a <= of; a++)
+	if (!seen[a])
+	  printf (" %d", a);
+      printf ("\n");
+    }
+  free (seen);
+  return bad || !of || got < of;
+}
+
+/* Streaming (-f).  Each thread reads the next square from the file,
+   under a lock, and reduces it just as fill() would have; only one
+   square per thread is held at a time. */
+
+struct
+{
+  struct sqfile *file;
+  long line, last;		/* number of the next square, last wanted */
+  int size;
+  pthread_mutex_t lock;
+} stream = { NULL, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+
+int
+islatin (entry s[SIZE][SIZE], int size)
+{
+  /* nonzero if s is a complete Latin square */
+  unsigned int row[SIZE], col[SIZE];
+  int i, j;
+  memset (row, 0, sizeof (row));
+  memset (col, 0, sizeof (col));
+  for (i = 0; i < size; i++)
+    for (j = 0; j < size; j++)
+      {
+	if (!s[i][j] || (row[i] | col[j]) & 1u << s[i][j])
+	  return 0;
+	row[i] |= 1u << s[i][j];
+	col[j] |= 1u << s[i][j];
+      }
+  return 1;
+}
+
+int
+nextsquare (entry s[SIZE][SIZE])
+{
+  /* the next Latin square wanted, read into s; 0 when there are no
+     more.  Anything else in the file is reported and passed over. */
+  int r, t[SIZE * SIZE];
+  pthread_mutex_lock (&stream.lock);
+  for (;;)
+    {
+      r = 0;
+      if (stream.line > stream.last)
+	break;
+      r = sqf_read (stream.file, t, stream.size);
+      narrow (t, s, stream.size);
+      if (r == 0)
+	break;
+      stream.line++;
+      if (r > 0 && islatin (s, stream.size))
+	break;
+      pthread_mutex_lock (&outlock);
+      printf ("square %ld is not a Latin square of order %d\n",
+	      stream.line - 1, stream.size);
+      pthread_mutex_unlock (&outlock);
+    }
+  pthread_mutex_unlock (&stream.lock);
+  return r;
+}
+
+void *
+streamer (void *arg)
+{
+  entry s[SIZE][SIZE];
+  int size = stream.size;
+  if (usedlx)
+    dlxfill2 = dlx_new (size, size);
+  memset (s, 0, sizeof (s));
+  while (nextsquare (s))
+    {
+      initused (s, size);
+      reduce (s, size, -1);
+    }
+  pthread_mutex_lock (&outlock);
+  squares += count;
+  pthread_mutex_unlock (&outlock);
+  dlx_free (dlxfill2);
+  free (witness);
+  return NULL;
+}
+
+void
+streamsquares (struct sqfile *f, long first, long last, int size,
+	       int threads)
+{
+  /* reduce squares first..last of f with the given number of threads */
+  pthread_t *tid;
+  int i;
+
+  stream.file = f;
+  stream.size = size;
+  stream.line = first;
+  stream.last = last;
+  if (sqf_skip (f, first - 1) < first - 1)
+    return;
+  tid = malloc (threads * sizeof (pthread_t));
+  if (!tid)
+    {
+      printf ("malloc failed\n");
+      exit (1);
+    }
+  for (i = 0; i < threads; i++)
+    pthread_create (&tid[i], NULL, streamer, NULL);
+  for (i = 0; i < threads; i++)
+    pthread_join (tid[i], NULL);
+  free (tid);
+  sqf_close (f);
+}
+
+/* Local search (recflag 4), for orders too large to get anywhere by
+   completing partial squares.  Each square is reduced over and over by
+   chains shared out between the -j threads.  A chain starts with a
+   greedy reduction of the whole square in a random order, then puts
+   back a few of the entries removed and reduces again, step after
+   step: the entries kept are tried in a new random order, and those
+   put back after them, since tried first they would only come out
+   again.  The new critical set replaces the old if
+   it is larger, and if it is d entries smaller with probability
+   temp^d, where temp falls at every step (simulated annealing).  A
+   chain ends after size*size steps without beating its own best.
+
+   Chain k of a square draws from its own generator seeded with
+   seed + k (-r, or the clock), so -r seed+k -n 1 repeats it.  The
+   search of a square stops after -n chains (default one per thread)
+   or -t seconds, and a critical set is printed, with the seed of its
+   chain, whenever it beats the largest found so far. */
+
+#define ANNEALTEMP 0.5		/* chance of accepting one entry fewer */
+#define ANNEALCOOL 0.995	/* and its fall at each step */
+
+struct
+{
+  entry s[SIZE][SIZE];
+  int size, ic;
+  long next;			/* the next chain to start */
+  time_t end;			/* 0 for no time limit */
+  pthread_mutex_t lock;
+} anneal = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+int
+timeup (void)
+{
+  return anneal.end && time (NULL) >= anneal.end;
+}
+
+void
+shuffle (int *t, int n)
+{
+  /* put t[0..n-1] in a random order */
+  int i, j, x;
+  for (i = n - 1; i > 0; i--)
+    {
+      j = rnd () % (i + 1);
+      x = t[i];
+      t[i] = t[j];
+      t[j] = x;
+    }
+}
+
+int
+greedy (entry s[SIZE][SIZE], int cs, int size, int *t)
+{
+  /* try emptying the cs filled cells of s in the order given by t[],
+     leaving those whose removal gives a second completion; what is
+     left is critical, since emptying more cells cannot make a cell
+     removable again.  Returns its size. */
+  int n = cs, i, q, v;
+  struct cells p;
+  filled (s, size, &p);
+  for (i = 0; i < n; i++)
+    {
+      q = t[i];
+      if (witnessed (&p, q))
+	continue;
+      v = s[q / size][q % size];
+      clearcell (s, q / size, q % size);
+      STAT (recurse_fill2, size * size - cs);
+      if (kern->fill2 (s, cs - 1, 0) == 1)
+	{
+	  cs--;
+	  p.w[q / 64] &= ~(1ULL << (q % 64));
+	}
+      else
+	setcell (s, q / size, q % size, v);
+    }
+  return cs;
+}
+
+void
+better (entry s[SIZE][SIZE], int size, int cs, unsigned long long seed)
+{
+  /* report the critical set s if it is the largest so far */
+  pthread_mutex_lock (&outlock);
+  if (cs > max && cs >= minsize)
+    {
+      max = cs;
+      print (s, size);
+      printf ("%d:%d seed:%llu\n", anneal.ic, cs, seed);
+      fflush (stdout);
+    }
+  pthread_mutex_unlock (&outlock);
+}
+
+void
+chain (int size, unsigned long long seed)
+{
+  /* one annealing chain on the square latin[][] */
+  entry cur[SIZE][SIZE], s[SIZE][SIZE];
+  int t[SIZE * SIZE], e[SIZE * SIZE];
+  int cs, cs2, best, stall = 0, n, k, i, q;
+  double temp = ANNEALTEMP, p;
+
+  rndstate = seed;
+  memcpy (cur, latin, sizeof (cur));
+  initused (cur, size);
+  for (q = 0; q < size * size; q++)
+    t[q] = q;
+  shuffle (t, size * size);
+  best = cs = greedy (cur, size * size, size, t);
+  better (cur, size, cs, seed);
+  while (stall < size * size && !timeup ())
+    {
+      STAT (recurse_levels, 0);
+      /* put back k of the entries removed, chosen at random, and try
+         them last: tried first, they would only be removed again */
+      memcpy (s, cur, sizeof (s));
+      for (i = n = q = 0; q < size * size; q++)
+	if (s[q / size][q % size])
+	  t[i++] = q;
+	else
+	  e[n++] = q;
+      shuffle (t, cs);
+      shuffle (e, n);
+      k = 1 + rnd () % (n < size ? n : size);
+      for (i = 0; i < k; i++)
+	{
+	  q = t[cs + i] = e[i];
+	  s[q / size][q % size] = latin[q / size][q % size];
+	}
+      initused (s, size);
+      cs2 = greedy (s, cs + k, size, t);
+      for (p = 1, i = cs2; i < cs; i++)
+	p *= temp;
+      if (cs2 >= cs || (rnd () >> 11) * 0x1p-53 < p)
+	{
+	  memcpy (cur, s, sizeof (cur));
+	  cs = cs2;
+	}
+      if (cs2 > best)
+	{
+	  best = cs2;
+	  stall = 0;
+	  better (s, size, cs2, seed);
+	}
+      else
+	stall++;
+      temp *= ANNEALCOOL;
+    }
+}
+
+void *
+chainer (void *arg)
+{
+  long k;
+  if (usedlx)
+    dlxfill2 = dlx_new (anneal.size, anneal.size);
+  memcpy (latin, anneal.s, sizeof (latin));
+  for (;;)
+    {
+      pthread_mutex_lock (&anneal.lock);
+      k = -1;
+      if ((chains < 0 || anneal.next < chains) && !timeup ())
+	k = anneal.next++;
+      pthread_mutex_unlock (&anneal.lock);
+      if (k < 0)
+	break;
+      chain (anneal.size, chainseed + k);
+    }
+  dlx_free (dlxfill2);
+  free (witness);
+  return NULL;
+}
+
+void
+localsearch (entry s[SIZE][SIZE], int size, int ic)
+{
+  /* run the chains on the complete square s, which has ic
+     intercalates */
+  pthread_t *tid;
+  int i;
+
+  tid = malloc (chainthreads * sizeof (pthread_t));
+  if (!tid)
+    {
+      printf ("malloc failed\n");
+      exit (1);
+    }
+  memcpy (anneal.s, s, sizeof (anneal.s));
+  anneal.size = size;
+  anneal.ic = ic;
+  anneal.next = 0;
+  anneal.end = seconds ? time (NULL) + seconds : 0;
+  for (i = 0; i < chainthreads; i++)
+    pthread_create (&tid[i], NULL, chainer, NULL);
+  for (i = 0; i < chainthreads; i++)
+    pthread_join (tid[i], NULL);
+  free (tid);
+}
+
+/* Verifying (-v).  A partial square is a critical set when it has one
+   completion and emptying any of its cells lets in a second.  The
+   completion is found with Dancing Links; then the -j threads take the
+   filled cells one at a time, each keeping its own witnesses against
+   the completion, so that a trade found for one cell settles others. */
+
+struct
+{
+  entry s[SIZE][SIZE], latin[SIZE][SIZE];
+  int size, cs, next;		/* next: the next cell to check */
+  char spare[SIZE * SIZE];	/* cells that can be emptied */
+  pthread_mutex_t lock;
+} check = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static int
+dlxkeep (int *sq, void *arg)
+{
+  /* keep the completion found (the second, if there are two) */
+  memcpy (arg, sq, order * order * sizeof (int));
+  return 0;
+}
+
+void *
+checker (void *arg)
+{
+  entry s[SIZE][SIZE];
+  struct cells p;
+  int q, v, size = check.size;
+  if (usedlx)
+    dlxfill2 = dlx_new (size, size);
+  memcpy (latin, check.latin, sizeof (latin));
+  memcpy (s, check.s, sizeof (s));
+  initused (s, size);
+  filled (s, size, &p);
+  for (;;)
+    {
+      pthread_mutex_lock (&check.lock);
+      while (check.next < size * size
+	     && !check.s[check.next / size][check.next % size])
+	check.next++;
+      q = check.next++;
+      pthread_mutex_unlock (&check.lock);
+      if (q >= size * size)
+	break;
+      /* a witness meeting s in q alone shows q is needed */
+      if (witnessed (&p, q))
+	continue;
+      v = s[q / size][q % size];
+      clearcell (s, q / size, q % size);
+      STAT (recurse_fill2, 0);
+      if (kern->fill2 (s, check.cs - 1, 0) == 1)
+	check.spare[q] = 1;
+      setcell (s, q / size, q % size, v);
+    }
+  dlx_free (dlxfill2);
+  free (witness);
+  return NULL;
+}
+
+int
+verify (struct dlx *d, entry s[SIZE][SIZE], int size, long line,
+	int threads)
+{
+  /* check the partial square s, number line of the file, printing
+     the verdict; returns 1 if it is a critical set */
+  pthread_t *tid;
+  int t[SIZE * SIZE], i, q, n, spare = 0;
+  long found;
+
+  widen (s, t, size);
+  found = dlx_complete (d, t, 2, dlxkeep, t);
+  if (found != 1)
+    {
+      printf ("square %ld: %s\n", line,
+	      found ? "more than one completion" : "no completion");
+      return 0;
+    }
+  memcpy (check.s, s, sizeof (check.s));
+  narrow (t, check.latin, size);
+  check.size = size;
+  for (check.cs = q = 0; q < size * size; q++)
+    check.cs += s[q / size][q % size] != 0;
+  check.next = 0;
+  memset (check.spare, 0, sizeof (check.spare));
+
+  n = threads < check.cs ? threads : check.cs;
+  tid = malloc ((n + 1) * sizeof (pthread_t));
+  if (!tid)
+    {
+      printf ("malloc failed\n");
+      exit (1);
+    }
+  for (i = 0; i < n; i++)
+    pthread_create (&tid[i], NULL, checker, NULL);
+  for (i = 0; i < n; i++)
+    pthread_join (tid[i], NULL);
+  free (tid);
+
+  for (q = 0; q < size * size; q++)
+    spare += check.spare[q];
+  if (!spare)
+    {
+      printf ("square %ld: critical set of size %d\n", line, check.cs);
+      return 1;
+    }
+  /* the cells that are not needed, as (row,column) from (1,1) */
+  printf ("square %ld: %d of %d entries not needed:", line, spare,
+	  check.cs);
+  for (q = 0; q < size * size; q++)
+    if (check.spare[q])
+      printf (" (%d,%d)", q / size + 1, q % size + 1);
+  printf ("\n");
+  return 0;
+}
+
+int
+verifysquares (char *name, long first, long last, int size, int threads)
+{
+  /* check squares first..last of the file name; the exit status is 1
+     if any is not a critical set */
+  struct sqfile *f;
+  struct dlx *d;
+  entry s[SIZE][SIZE];
+  int t[SIZE * SIZE], r, bad = 0;
+  long line;
+
+  if ((f = sqf_open (name, size)) == NULL)
+    return 1;
+  if (sqf_skip (f, first - 1) < first - 1)
+    {
+      sqf_close (f);
+      return 0;
+    }
+  d = dlx_new (size, size);
+  memset (s, 0, sizeof (s));
+  for (line = first; line <= last && (r = sqf_read (f, t, size)); line++)
+    {
+      if (r < 0)
+	{
+	  printf ("square %ld is not a partial Latin square of order %d\n",
+		  line, size);
+	  bad = 1;
+	  continue;
+	}
+      narrow (t, s, size);
+      if (!verify (d, s, size, line, threads))
+	bad = 1;
+      fflush (stdout);
+    }
+  dlx_free (d);
+  sqf_close (f);
+  return bad;
 }
@@ -0,0 +1,661 @@
+/*
+ * kernels.h - the inner searches of find-lcs: fill(), fill2() and what
+ * they call, the recurse*() reductions and probe(), which estimates the
+ * size of a fill() tree.
+ *
+ * find-lcs.c includes this file once for each order it has kernels for,
+ * with ORDER defined as that order, and once with ORDER 0 for every
+ * other order.  Inside, size is ORDER, so the compiler sees the loop
+ * bounds and divides by a constant; with ORDER 0 it is the global order.
+ * Each function name(...) comes out as name_ORDER(...), and the
+ * functions are gathered in struct kernels kernels_ORDER, which main()
+ * picks from by order.
+ *
+ * Everything the kernels use from find-lcs.c (the square state, the
+ * witnesses, reduce(), report() and the rest) must be declared before
+ * the first inclusion.
+ */
+
+#define K2(name, n) name##_##n
+#define K1(name, n) K2(name, n)
+#define K(name) K1(name, ORDER)
+
+#if ORDER
+#define size ORDER
+#else
+#define size order
+#endif
+
+static int
+K (newic) (entry s[SIZE][SIZE], int b, int a)
+{
+  /* the intercalates completed by the entry just placed at (b, a) */
+  int j, w, r, n = 0;
+  for (j = 0; j < size; j++)
+    {
+      w = s[b][j];
+      if (j == a || !w || !(colused[a] >> w & 1))
+	continue;
+      r = colrow[a][w];
+      n += s[r][j] == s[b][a];
+    }
+  return n;
+}
+
+static int
+K (icount) (entry s[SIZE][SIZE])
+{
+  /* O(size^3) intercalate counting */
+  int r, c, f, ci[SIZE][SIZE + 1], i;
+
+  /* build a row and column index for each row and column */
+
+  /* ri[x][y] records in which column element y occurs is in row x */
+  /* ci[x][y] records in which row element y is in row x */
+
+  i = 0;
+  for (r = 0; r < size; r++)
+    for (c = 0; c < size; c++)
+      ci[c][s[r][c]] = r;
+  for (r = 0; r < size - 1; r++)
+    for (c = 0; c < size - 1; c++)
+      for (f = c + 1; f < size; f++)
+	{
+	  int e = s[r][f], y = ci[c][e];
+	  if (y < r)
+	    continue;
+	  i += s[r][c] == s[y][f];
+	}
+  return i;
+}
+
+/* For the smallest orders a square is too few vectors for sweep() to
+   pay, and propagate() places each single as it finds it. */
+#if ORDER == 5 || ORDER == 6
+
+static unsigned int
+K (propagate) (entry s[SIZE][SIZE], int level, int *trail, int *placed)
+{
+  /* place the forced entries of s until there are none left: naked
+     singles (a cell with one candidate) and hidden singles (a symbol
+     with one possible cell in a row or column).  The cells placed are
+     listed in trail[], *placed of them.  Returns the cell to branch
+     on as sweep() below would, or 0 if some cell, or some symbol
+     missing from a row or column, has nowhere to go. */
+  unsigned int m, once, twice, need, key = NOCELL;
+  int r, c, i, j, n = 0, changed = 1;
+  while (changed)
+    {
+      changed = 0;
+      for (r = 0; r < size; r++)
+	for (c = 0; c < size; c++)
+	  if (!s[r][c])
+	    {
+	      m = testone (r, c, level);
+	      if (!m)
+		{
+		  *placed = n;
+		  return 0;
+		}
+	      if (!(m & (m - 1)))
+		{
+		  setcell (s, r, c, __builtin_ctz (m));
+		  trail[n++] = r * size + c;
+		  changed = 1;
+		}
+	    }
+      /* rows are lines 0..size-1, columns size..2*size-1 */
+      for (i = 0; i < 2 * size; i++)
+	{
+	  once = twice = 0;
+	  for (j = 0; j < size; j++)
+	    {
+	      r = i < size ? i : j;
+	      c = i < size ? j : i - size;
+	      if (!s[r][c])
+		{
+		  m = testone (r, c, level);
+		  twice |= once & m;
+		  once |= m;
+		}
+	    }
+	  need = full & ~(i < size ? rowused[i] : colused[i - size]);
+	  if (need & ~once)
+	    {
+	      *placed = n;
+	      return 0;
+	    }
+	  if (!(once & ~twice))
+	    continue;
+	  /* place one symbol; the others are found on the next pass */
+	  m = 1u << __builtin_ctz (once & ~twice);
+	  for (j = 0; j < size; j++)
+	    {
+	      r = i < size ? i : j;
+	      c = i < size ? j : i - size;
+	      if (!s[r][c] && testone (r, c, level) & m)
+		break;
+	    }
+	  setcell (s, r, c, __builtin_ctz (m));
+	  trail[n++] = r * size + c;
+	  changed = 1;
+	}
+    }
+  *placed = n;
+  if (level + n == size * size)
+    return key;
+  for (r = 0; r < size; r++)
+    for (c = 0; c < size; c++)
+      if (!s[r][c])
+	{
+	  m = __builtin_popcount (testone (r, c, level)) << 10 | (r * size + c);
+	  if (m < key)
+	    key = m;
+	}
+  return key;
+}
+
+#else
+
+CLONED static unsigned int
+K (sweep) (entry s[SIZE][SIZE], struct sweep *w)
+{
+  /* the candidates of every empty cell of s, and the symbols found
+     once and twice in each line, into w.  Returns the empty cell with
+     fewest candidates, the first in row order, as count * 1024 +
+     position, or NOCELL if s is full. */
+  const lanes lane = { 0, 1, 2, 3, 4, 5, 6, 7 }, zero = { 0 };
+  const lanes fold[3] = {
+    {4, 5, 6, 7, 0, 1, 2, 3}, {2, 3, 0, 1, 6, 7, 4, 5}, {1, 0, 3, 2, 5, 4, 7, 6}
+  };
+  lanes m, n, key, keep, lo, lt, half, best = zero + NOCELL;
+  lanes once[CANDCOLS / 8], twice[CANDCOLS / 8];
+  lanebytes row;
+  unsigned int min = NOCELL, o, t;
+  int r, c, k;
+  memset (once, 0, sizeof (once));
+  memset (twice, 0, sizeof (twice));
+  for (r = 0; r < size; r++)
+    {
+      o = t = 0;
+      for (c = 0; c < size; c += 8)
+	{
+	  if (c + 8 <= SIZE)
+	    memcpy (&row, &s[r][c], sizeof (row));
+	  else
+	    {
+	      memset (&row, 0, sizeof (row));
+	      memcpy (&row, &s[r][c], SIZE - c);
+	    }
+	  memcpy (&m, &colused[c], sizeof (m));
+	  keep = __builtin_convertvector (row == 0, lanes)
+	    & (lanes) (c + lane < size);
+	  m = full & ~(rowused[r] | m) & keep;
+	  memcpy (&w->cand[r][c], &m, sizeof (m));
+	  twice[c / 8] |= once[c / 8] & m;
+	  once[c / 8] |= m;
+	  /* the same for the row, folding the lanes in halves */
+	  lo = m;
+	  lt = zero;
+	  for (k = 0; k < 3; k++)
+	    {
+	      half = __builtin_shuffle (lo, fold[k]);
+	      lt |= __builtin_shuffle (lt, fold[k]) | (lo & half);
+	      lo |= half;
+	    }
+	  t |= lt[0] | (o & lo[0]);
+	  o |= lo[0];
+	  /* popcount, lane by lane */
+	  n = m - (m >> 1 & 0x55555555);
+	  n = (n & 0x33333333) + (n >> 2 & 0x33333333);
+	  n = (n + (n >> 4)) & 0x0f0f0f0f;
+	  n += n >> 8;
+	  n += n >> 16;
+	  key = (n & 0x3f) << 10 | (r * size + c + lane);
+	  key = (key & keep) | (NOCELL & ~keep);
+	  keep = (lanes) (key < best);
+	  best = (key & keep) | (best & ~keep);
+	}
+      w->once[r] = o;
+      w->twice[r] = t;
+    }
+  memcpy (&w->once[size], once, sizeof (once));
+  memcpy (&w->twice[size], twice, sizeof (twice));
+  for (k = 0; k < 8; k++)
+    if (best[k] < min)
+      min = best[k];
+  return min;
+}
+
+static unsigned int
+K (propagate) (entry s[SIZE][SIZE], int level, int *trail, int *placed)
+{
+  /* place the forced entries of s until there are none left: naked
+     singles (a cell with one candidate) and hidden singles (a symbol
+     with one possible cell in a row or column), all those one sweep()
+     shows at a time.  The cells placed are listed in trail[], *placed
+     of them.  Returns the cell to branch on as sweep() gives it, or 0
+     if some cell, or some symbol missing from a row or column, has
+     nowhere to go. */
+  struct sweep w;
+  unsigned int key, m, need, lone;
+  int r, c, i, j, n = 0, changed = 1;
+  while (changed)
+    {
+      changed = 0;
+      key = K (sweep) (s, &w);
+      if (key < 1024)
+	goto DEAD;
+      if (key >> 10 == 1)
+	{
+	  for (r = 0; r < size; r++)
+	    for (c = 0; c < size; c++)
+	      if ((m = w.cand[r][c]) && !(m & (m - 1)))
+		{
+		  /* an earlier single may have taken it */
+		  if (!(testone (r, c, level) & m))
+		    goto DEAD;
+		  setcell (s, r, c, __builtin_ctz (m));
+		  trail[n++] = r * size + c;
+		}
+	  changed = 1;
+	}
+      /* rows are lines 0..size-1, columns size..2*size-1 */
+      for (i = 0; i < 2 * size; i++)
+	{
+	  need = full & ~(i < size ? rowused[i] : colused[i - size]);
+	  if (need & ~w.once[i])
+	    goto DEAD;
+	  for (lone = w.once[i] & ~w.twice[i]; lone; lone &= lone - 1)
+	    {
+	      m = lone & -lone;
+	      /* its one cell in the line, which is there since it is in
+	         once[i] */
+	      for (j = 0;; j++)
+		{
+		  r = i < size ? i : j;
+		  c = i < size ? j : i - size;
+		  if ((w.cand[r][c] & m) || j == size - 1)
+		    break;
+		}
+	      /* placed already, from the other line through the cell? */
+	      if (s[r][c] == __builtin_ctz (m))
+		continue;
+	      if (s[r][c] || !(testone (r, c, level) & m))
+		goto DEAD;
+	      setcell (s, r, c, __builtin_ctz (m));
+	      trail[n++] = r * size + c;
+	      changed = 1;
+	    }
+	}
+    }
+  *placed = n;
+  return key;
+DEAD:
+  *placed = n;
+  return 0;
+}
+#endif
+
+static int
+K (fill2) (entry s[SIZE][SIZE], int level, int pos)
+{
+  /* this function attempts to complete the 
+     partial Latin square supplied in the array s.
+     During the forcing process, if no element could
+     possibly *be* in a position, then there
+     is no point in continuing.  The function
+     returns the number of possible Latin squares
+     based on the given square.  */
+  unsigned int ret, key;
+  int a = 0, b = 0, c, poss = 0;
+  int trail[SIZE * SIZE], forced;
+  /* go through each element in the Latin square */
+  /* and test whether that element has a forced */
+  /* completion. if not, move on to semi-strong */
+
+  STAT (fill2_nodes, level);
+  /* are we already finished? */
+  if (level == size * size)
+    {
+      addwitness (s, size);
+      return 1;
+    }
+
+  if (dlxfill2)
+    return dlxsquare (dlxfill2, s, 2, dlxwitness);
+
+  /* try strong completion, then semistrong (hidden singles) */
+  key = K (propagate) (s, level, trail, &forced);
+  if (key < 1024)
+    {
+      STAT (fill2_dead_ends, level);
+      goto UNDO;
+    }
+  STATADD (fill2_forced, level, forced);
+  level += forced;
+  if (level == size * size)
+    {
+      addwitness (s, size);
+      poss = 1;
+      goto UNDO;
+    }
+
+  /* then critical: now try all possibilities, in the cell with the
+     fewest */
+  b = (key & 1023) / size;
+  a = (key & 1023) % size;
+  for (ret = testone (b, a, level); ret; ret &= ret - 1)
+    {
+      c = __builtin_ctz (ret);
+      setcell (s, b, a, c);
+      poss += K (fill2) (s, level + 1, b * size + a + 1);
+      clearcell (s, b, a);
+      /* return immediately if > 1 */
+      if (poss > 1)
+	{
+	  STAT (fill2_early_exits, level);
+	  break;
+	}
+    }
+  /* if one square fails,
+     forget about the rest */
+UNDO:
+  while (forced > 0)
+    {
+      forced--;
+      clearcell (s, trail[forced] / size, trail[forced] % size);
+    }
+  return poss;
+}
+
+static int
+K (fill) (entry s[SIZE][SIZE], int level, int pos)
+{
+  /* this function attempts to complete the
+     partial Latin square supplied in the array s.
+     During the forcing process, if no element could
+     possibly *be* in a position, then there
+     is no point in continuing.  The function
+     returns the number of possible Latin squares
+     based on the given square.  */
+  unsigned int ret;
+  int a = 0, b = 0, c, changed, mod = 1, mod1 = 1, mod2 = 1, poss = 0, xb = 0;
+  int ic = 0;
+  STAT (fill_nodes, level);
+  if (level == size * size)
+    {
+      reduce (s, size, mininter ? fillic : -1);
+      return 1;
+    }
+  /* too few intercalates whatever goes in the cells left? */
+  if (mininter && fillic + icbound[pos] < mininter)
+    {
+      STAT (fill_ic_cuts, level);
+      return 0;
+    }
+  if (dlxfill)
+    {
+      dlxsquare (dlxfill, s, 0, dlxleaf);
+      return 0;
+    }
+  /* try strong completion, then semistrong, then critical */
+  /* now try all possibilities */
+  a = pos % size;
+  b = pos / size;
+  while (s[b][a])
+    {
+      a++;
+      if (a == size)
+	{
+	  b++;
+	  a = 0;
+	}
+    }
+
+  ret = testone (b, a, level);
+  if (!ret)
+    STAT (fill_dead_ends, level);
+  for (; ret; ret &= ret - 1)
+    {
+      c = __builtin_ctz (ret);
+      setcell (s, b, a, c);
+      if (mininter)
+	{
+	  colrow[a][c] = b;
+	  ic = K (newic) (s, b, a);
+	  fillic += ic;
+	}
+      K (fill) (s, level + 1, b * size + a + 1);
+      if (mininter)
+	fillic -= ic;
+      clearcell (s, b, a);
+    }
+  /* if one square fails,
+     forget about the rest */
+  return 0;
+}
+
+static void
+K (recurse) (entry s[SIZE][SIZE], int cs, int ic)
+{
+  /* recursively remove entries from a uniquely completable set,
+     until only a critical set is left */
+  int q, badflag = 0;
+  struct cells p;
+  if (cs < minsize)
+    return;
+  STAT (recurse_levels, size * size - cs);
+  filled (s, size, &p);
+  for (q = 0; q < size * size; q++)
+    {
+      if (s[q / size][q % size] && !witnessed (&p, q))
+	{
+	  int tmp = s[q / size][q % size];
+	  clearcell (s, q / size, q % size);
+	  STAT (recurse_fill2, size * size - cs);
+	  if (K (fill2) (s, cs - 1, 0) == 1)
+	    {
+	      badflag = 1;
+	      break;
+	    }
+	  else
+	    setcell (s, q / size, q % size, tmp);
+	}
+    }
+  if (badflag)
+    K (recurse) (s, cs - 1, ic);
+  else
+    {
+      report (s, size, ic, cs);
+    }
+}
+
+static void
+K (recursemax) (entry s[SIZE][SIZE], int cs, int ic)
+{
+  /* same as recurse(), except remove entry with the most candidates */
+  int q, badflag = -1;
+  int retmax = -1;
+  struct cells p;
+  if (cs < minsize)
+    return;
+  STAT (recurse_levels, size * size - cs);
+  filled (s, size, &p);
+  for (q = 0; q < size * size; q++)
+    {
+      if (s[q / size][q % size] && !witnessed (&p, q))
+	{
+	  int tmp = s[q / size][q % size], x, n;
+	  clearcell (s, q / size, q % size);
+	  STAT (recurse_fill2, size * size - cs);
+	  x = K (fill2) (s, cs - 1, 0);
+	  n = __builtin_popcount (testone (q / size, q % size,
+					   size * size - cs));
+
+	  if (x == 1 && n > retmax)
+	    {
+	      retmax = n;
+	      badflag = q;
+	    }
+
+	  setcell (s, q / size, q % size, tmp);
+	}
+    }
+  if (badflag != -1)
+    {
+      clearcell (s, badflag / size, badflag % size);
+      K (recursemax) (s, cs - 1, ic);
+    }
+  else
+    {
+      report (s, size, ic, cs);
+    }
+}
+
+static void
+K (recursemin) (entry s[SIZE][SIZE], int cs, int ic)
+{
+  /* same as recurse(), except remove entries with the fewest candidates */
+  int q, badflag = -1;
+  int retmin = 99;
+  struct cells p;
+  if (cs < minsize)
+    return;
+  STAT (recurse_levels, size * size - cs);
+  filled (s, size, &p);
+  for (q = 0; q < size * size; q++)
+    {
+      if (s[q / size][q % size] && !witnessed (&p, q))
+	{
+	  int tmp = s[q / size][q % size], x, n;
+	  clearcell (s, q / size, q % size);
+	  STAT (recurse_fill2, size * size - cs);
+	  x = K (fill2) (s, cs - 1, 0);
+	  n = __builtin_popcount (testone (q / size, q % size,
+					   size * size - cs));
+
+	  if (x == 1 && n < retmin)
+	    {
+	      retmin = n;
+	      badflag = q;
+	    }
+
+	  setcell (s, q / size, q % size, tmp);
+	}
+    }
+  if (badflag != -1)
+    {
+      clearcell (s, badflag / size, badflag % size);
+      K (recursemin) (s, cs - 1, ic);
+    }
+  else
+    {
+      report (s, size, ic, cs);
+    }
+}
+
+static void
+K (recursernd) (entry s[SIZE][SIZE], int cs, int ic)
+{
+  /* same as recurse(), except remove entries randomly */
+  int t[SIZE * SIZE], count = 0, q, badflag = 0;
+  struct cells p;
+  if (cs < minsize)
+    return;
+  STAT (recurse_levels, size * size - cs);
+  memset (t, 0, sizeof (t));
+  filled (s, size, &p);
+  for (q = 0; q < size * size; q++)
+    {
+      if (s[q / size][q % size] && !witnessed (&p, q))
+	{
+	  int tmp = s[q / size][q % size], x;
+	  clearcell (s, q / size, q % size);
+	  STAT (recurse_fill2, size * size - cs);
+	  if (K (fill2) (s, cs - 1, 0) == 1)
+	    {
+	      badflag = 1;
+	      t[count++] = q;
+	    }
+	  setcell (s, q / size, q % size, tmp);
+	}
+    }
+  if (badflag)
+    {
+      int rand1;
+      rand1 = random () % count;
+      clearcell (s, t[rand1] / size, t[rand1] % size);
+
+      K (recursernd) (s, cs - 1, ic);
+    }
+  else
+    {
+      report (s, size, ic, cs);
+    }
+}
+
+static double
+K (probe) (entry s[SIZE][SIZE], int level, int pos)
+{
+  /* estimate the work of fill (s, level, pos) by one random dive down
+     its tree (Knuth's estimator): each node on the way stands for the
+     product of the branching above it.  A complete square counts as
+     size * size nodes, for the fill2() calls of reducing it.  s is
+     left as it was found. */
+  unsigned int ret;
+  int a, b, c, k, n = 0, trail[SIZE * SIZE], ics[SIZE * SIZE];
+  double est = 1, w = 1;
+  while (level < size * size)
+    {
+      if (mininter && fillic + icbound[pos] < mininter)
+	break;
+      a = pos % size;
+      b = pos / size;
+      while (s[b][a])
+	{
+	  a++;
+	  if (a == size)
+	    {
+	      b++;
+	      a = 0;
+	    }
+	}
+      ret = testone (b, a, level);
+      if (!(k = __builtin_popcount (ret)))
+	break;
+      for (c = rnd () % k; c > 0; c--)
+	ret &= ret - 1;
+      c = __builtin_ctz (ret);
+      setcell (s, b, a, c);
+      ics[n] = 0;
+      if (mininter)
+	{
+	  colrow[a][c] = b;
+	  ics[n] = K (newic) (s, b, a);
+	  fillic += ics[n];
+	}
+      trail[n++] = b * size + a;
+      w *= k;
+      est += w;
+      level++;
+      pos = b * size + a + 1;
+    }
+  if (level == size * size)
+    est += w * (size * size - 1);
+  while (n > 0)
+    {
+      n--;
+      fillic -= ics[n];
+      clearcell (s, trail[n] / size, trail[n] % size);
+    }
+  return est;
+}
+
+static const struct kernels K (kernels) = {
+  K (fill), K (fill2), K (icount), K (probe),
+  {K (recurse), K (recursemax), K (recursemin), K (recursernd)}
+};
+
+#undef size
+#undef ORDER
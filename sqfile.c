@@ -0,0 +1,206 @@
+/*
+ * sqfile.c - reading Latin squares from text and packed files.  See
+ * sqfile.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "sqfile.h"
+
+/* the next word that is a row, into w; 0 at end of file */
+static int
+nextrow(FILE * f, char *w)
+{
+	int             ch;
+
+	do {
+		if (fscanf(f, "%99s", w) != 1)
+			return 0;
+		if (w[0] == '#')	/* a comment, to the end of the line */
+			while ((ch = getc(f)) != EOF && ch != '\n')
+				;
+	} while (w[0] == '#' || strchr(w, ':'));
+	return 1;
+}
+
+static int
+symbol(int ch, int n)
+{
+	int             v = -1;
+
+	if (ch == '.' || ch == '`')
+		v = 0;
+	else if (ch >= '0' && ch <= '9')
+		v = ch - '0';
+	else if (ch >= 'a' && ch <= 'z')
+		v = ch - 'a' + 1;
+	return v <= n ? v : -1;
+}
+
+int
+sq_read(FILE * f, int n, int *sq, int stride)
+{
+	char            w[100];
+	int             i, j, v, ok = 1;
+
+	for (i = 0; i < n; i++) {
+		if (!nextrow(f, w))
+			return 0;
+		if ((int) strlen(w) != n)
+			ok = 0;
+		for (j = 0; j < n; j++) {
+			v = ok ? symbol(w[j], n) : -1;
+			if (v < 0)
+				ok = 0;
+			sq[i * stride + j] = v < 0 ? 0 : v;
+		}
+	}
+	return ok ? 1 : -1;
+}
+
+long
+sq_skip(FILE * f, int n, long count)
+{
+	char            w[100];
+	long            k;
+	int             i;
+
+	for (k = 0; k < count; k++)
+		for (i = 0; i < n; i++)
+			if (!nextrow(f, w))
+				return k;
+	return count;
+}
+
+struct sqfile {
+	int             n;
+	FILE           *fp;		/* text files */
+	unsigned char  *map;		/* packed files */
+	size_t          len;
+	long            count, pos;	/* squares in the file, next one */
+	int             rec;		/* bytes per square */
+};
+
+struct sqfile  *
+sqf_open(const char *name, int n)
+{
+	struct sqfile  *f;
+	struct stat     st;
+	unsigned char   h[SQP_HEADER];
+	int             fd, i;
+
+	f = (struct sqfile *) calloc(1, sizeof(struct sqfile));
+	if (!f) {
+		printf("calloc failed\n");
+		exit(1);
+	}
+	f->n = n;
+	f->rec = (n * n + 1) / 2;
+	if (strcmp(name, "-") == 0) {
+		f->fp = stdin;
+		return f;
+	}
+	if ((f->fp = fopen(name, "r")) == NULL) {
+		printf("failed to open %s\n", name);
+		free(f);
+		return NULL;
+	}
+	if (fread(h, 1, SQP_HEADER, f->fp) != SQP_HEADER ||
+	    memcmp(h, "LSQP", 4) != 0) {
+		rewind(f->fp);
+		return f;	/* text */
+	}
+	if (h[4] != 1 || h[5] != n) {
+		printf("%s holds squares of order %d, not %d\n", name, h[5], n);
+		goto FAIL;
+	}
+	for (i = 7; i >= 0; i--)
+		f->count = f->count << 8 | h[8 + i];
+	fd = fileno(f->fp);
+	/* divided, since a bad count could overflow count * rec */
+	if (fstat(fd, &st) < 0 || f->count < 0 ||
+	    f->count > (st.st_size - SQP_HEADER) / f->rec) {
+		printf("%s is truncated\n", name);
+		goto FAIL;
+	}
+	f->len = st.st_size;
+	f->map = (unsigned char *) mmap(NULL, f->len, PROT_READ, MAP_SHARED, fd, 0);
+	if (f->map == MAP_FAILED) {
+		printf("failed to map %s\n", name);
+		goto FAIL;
+	}
+	fclose(f->fp);
+	f->fp = NULL;
+	return f;
+
+FAIL:
+	fclose(f->fp);
+	free(f);
+	return NULL;
+}
+
+int
+sqf_read(struct sqfile * f, int *sq, int stride)
+{
+	if (f->fp)
+		return sq_read(f->fp, f->n, sq, stride);
+	if (f->pos >= f->count)
+		return 0;
+	return sqp_unpack(f->map + SQP_HEADER + f->pos++ * f->rec, f->n, sq,
+			  stride);
+}
+
+long
+sqf_skip(struct sqfile * f, long count)
+{
+	if (f->fp)
+		return sq_skip(f->fp, f->n, count);
+	if (count > f->count - f->pos)
+		count = f->count - f->pos;
+	f->pos += count;
+	return count;
+}
+
+int
+sqf_eof(struct sqfile * f)
+{
+	return f->fp ? feof(f->fp) : f->pos >= f->count;
+}
+
+void
+sqf_close(struct sqfile * f)
+{
+	if (f->fp && f->fp != stdin)
+		fclose(f->fp);
+	if (f->map)
+		munmap(f->map, f->len);
+	free(f);
+}
+
+void
+sqp_pack(unsigned char *rec, int n, const int *sq, int stride)
+{
+	int             k;
+
+	memset(rec, 0, (n * n + 1) / 2);
+	for (k = 0; k < n * n; k++)
+		rec[k / 2] |= (sq[k / n * stride + k % n] & 15) << (k % 2 * 4);
+}
+
+int
+sqp_unpack(const unsigned char *rec, int n, int *sq, int stride)
+{
+	int             k, v, ok = 1;
+
+	for (k = 0; k < n * n; k++) {
+		v = rec[k / 2] >> (k % 2 * 4) & 15;
+		if (v > n)
+			ok = 0;
+		sq[k / n * stride + k % n] = v > n ? 0 : v;
+	}
+	return ok ? 1 : -1;
+}
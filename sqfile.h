@@ -0,0 +1,64 @@
+/*
+ * sqfile.h - reading Latin squares from files, shared by find-lcs, tradegu
+ * and sqpack.
+ *
+ * Text files: a square of order n is n words of n symbols, one word per
+ * row, separated by any white space: a square per line as in 6list, or a
+ * row per line as in 7list.  Symbols are digits, or letters from a = 1 as
+ * find-lcs prints them; 0, '.' and '`' (an empty cell printed by find-lcs)
+ * are empty cells.  Words containing ':' (the "intercalates:size" lines
+ * find-lcs prints after each critical set) are skipped, and so are lines
+ * from a word starting with '#' (the summaries of find-lcs --shard), so
+ * find-lcs output can be read back.
+ *
+ * Packed files (written by sqpack) start with a 16 byte header: the magic
+ * "LSQP", a version byte (1), the order, two zero bytes and the number of
+ * squares as 8 bytes, least significant first.  Then come the squares,
+ * (n*n+1)/2 bytes each: cell k = r*n + c is in the low half of byte k/2
+ * when k is even, the high half when it is odd.  Symbols
+ * are 1..n and 0 is an empty cell, so orders up to 15 fit.  The reader
+ * maps the file, so any square can be reached directly.
+ *
+ * Squares are stored in int arrays with stride ints per row, as for dlx.h.
+ */
+
+#ifndef SQFILE_H
+#define SQFILE_H
+
+#include <stdio.h>
+
+#define SQP_HEADER 16
+#define SQP_MAXORDER 15
+
+/*
+ * Text files read directly.  sq_read() returns 1, 0 at end of file, or -1
+ * if a row has the wrong length or an unknown symbol (the rest of the
+ * square is still read, so the next call starts at the following square).
+ */
+int             sq_read(FILE * f, int n, int *sq, int stride);
+
+/* skip count squares; returns the number skipped, short at end of file */
+long            sq_skip(FILE * f, int n, long count);
+
+/*
+ * Files of either kind.  sqf_open() takes a file name, or - for standard
+ * input (text only), and returns NULL after printing a message if the file
+ * cannot be opened or is a packed file of another order.  sqf_read() and
+ * sqf_skip() work as above; skipping in a packed file takes no time.
+ */
+struct sqfile;
+
+struct sqfile  *sqf_open(const char *name, int n);
+int             sqf_read(struct sqfile * f, int *sq, int stride);
+long            sqf_skip(struct sqfile * f, long count);
+int             sqf_eof(struct sqfile * f);
+void            sqf_close(struct sqfile * f);
+
+/*
+ * pack / unpack one square of a packed file (rec holds (n*n+1)/2 bytes);
+ * sqp_unpack() returns 1, or -1 if a symbol is above n, as sq_read() does
+ */
+void            sqp_pack(unsigned char *rec, int n, const int *sq, int stride);
+int             sqp_unpack(const unsigned char *rec, int n, int *sq, int stride);
+
+#endif
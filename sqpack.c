@@ -0,0 +1,97 @@
+/*
+ * sqpack - convert a file of Latin squares to the packed format described
+ * in sqfile.h, or back to text.
+ *
+ * Packed files let tradegu and find-lcs -f start at any square without
+ * reading the ones before it, e.g. for splitting 8list between many jobs.
+ *
+ * Compile with: gcc -O3 -o sqpack sqpack.c sqfile.c
+ * Usage: sqpack [-u] size infile outfile
+ * where: infile is text (6list, 7list or find-lcs output) or, with -u, packed
+ * or text; - reads standard input
+ * -u = write text instead, one square per line, digits up to order 9 and
+ * letters (a = 1) above
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sqfile.h"
+
+#define SIZE SQP_MAXORDER
+
+int
+main(int argc, char **argv)
+{
+	struct sqfile  *in;
+	FILE           *out;
+	int             sq[SIZE][SIZE], n, i, j, r, opt, unpack = 0;
+	unsigned char   h[SQP_HEADER], rec[(SIZE * SIZE + 1) / 2];
+	long            count = 0, line = 0;
+
+	while ((opt = getopt(argc, argv, "u")) != -1) {
+		if (opt == 'u')
+			unpack = 1;
+		else
+			argc = 0;
+	}
+	if (argc - optind != 3) {
+		printf("usage: %s [-u] size infile outfile\n", argv[0]);
+		exit(0);
+	}
+	argv += optind - 1;
+	n = atoi(argv[1]);
+	if (n < 1 || n > SIZE) {
+		printf("size must be 1 to %d\n", SIZE);
+		exit(1);
+	}
+	if ((in = sqf_open(argv[2], n)) == NULL)
+		exit(1);
+	if ((out = fopen(argv[3], unpack ? "w" : "wb")) == NULL) {
+		printf("failed to open %s\n", argv[3]);
+		exit(1);
+	}
+	/* the count is filled in at the end */
+	memset(h, 0, sizeof(h));
+	memcpy(h, "LSQP", 4);
+	h[4] = 1;
+	h[5] = n;
+	if (!unpack)
+		fwrite(h, 1, SQP_HEADER, out);
+
+	while ((r = sqf_read(in, &sq[0][0], SIZE)) != 0) {
+		line++;
+		if (r < 0) {
+			printf("square %ld is malformed\n", line);
+			exit(1);
+		}
+		if (unpack) {
+			for (i = 0; i < n; i++) {
+				for (j = 0; j < n; j++)
+					fputc(!sq[i][j] ? '.' : n <= 9 ?
+					    '0' + sq[i][j] : 'a' + sq[i][j] - 1, out);
+				fputc(i < n - 1 ? ' ' : '\n', out);
+			}
+		} else {
+			sqp_pack(rec, n, &sq[0][0], SIZE);
+			fwrite(rec, 1, (n * n + 1) / 2, out);
+		}
+		count++;
+	}
+	if (!unpack) {
+		for (i = 0; i < 8; i++)
+			h[8 + i] = count >> (8 * i) & 255;
+		if (fseek(out, 0, SEEK_SET) != 0) {
+			printf("%s must be a file\n", argv[3]);
+			exit(1);
+		}
+		fwrite(h, 1, SQP_HEADER, out);
+	}
+	if (fclose(out)) {
+		printf("failed to write %s\n", argv[3]);
+		exit(1);
+	}
+	sqf_close(in);
+	return 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * stats.h - search counters for find-lcs and tradegu, compiled in with
+ * -DSTATS and to nothing otherwise.
+ *
+ * A program lists its counters before including this file:
+ *
+ *	#define STATS_COUNTERS(X) X(fill_nodes) X(add_calls)
+ *	#include "stats.h"
+ *
+ * then counts with STAT(name, depth) or STATADD(name, depth, n), where depth
+ * is the level of the search (0 if there is none), and times with
+ * STATTIMER(t) ... STATELAPSED(name, t), which adds nanoseconds.  Calling
+ * stats_init() at the start of main() prints every counter, in total and by
+ * depth, to stderr at exit and whenever the process gets SIGUSR1; with
+ * STATS_JSON set in the environment the report is one line of JSON.
+ *
+ * Each thread counts into its own block, so counting needs no locking; the
+ * report adds up the blocks of all threads, finished or not.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#ifdef STATS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+
+#define STATDEPTH 1024		/* deeper levels are counted in the last */
+
+#define STATS_ENUM(name) STAT_##name,
+#define STATS_NAME(name) #name,
+enum {
+	STATS_COUNTERS(STATS_ENUM) NSTATS
+};
+static const char *stats_names[] = {STATS_COUNTERS(STATS_NAME) NULL};
+
+struct statblock {
+	long            c[NSTATS][STATDEPTH];
+	struct statblock *next;
+};
+
+static struct statblock *stats_all;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct statblock *stats_mine;
+static volatile sig_atomic_t stats_wanted;
+
+static void     stats_report(void);
+
+static struct statblock *
+stats_block(void)
+{
+	/* the calling thread's block, made on first use */
+	if (stats_wanted) {
+		stats_wanted = 0;
+		stats_report();
+	}
+	if (!stats_mine) {
+		stats_mine = (struct statblock *) calloc(1, sizeof(struct statblock));
+		if (!stats_mine) {
+			printf("calloc failed\n");
+			exit(1);
+		}
+		pthread_mutex_lock(&stats_lock);
+		stats_mine->next = stats_all;
+		stats_all = stats_mine;
+		pthread_mutex_unlock(&stats_lock);
+	}
+	return stats_mine;
+}
+
+#define STATADD(name, depth, n) do {					\
+	struct statblock *b_ = stats_mine && !stats_wanted ?		\
+	    stats_mine : stats_block();					\
+	int d_ = (depth);						\
+	b_->c[STAT_##name][d_ < STATDEPTH ? d_ : STATDEPTH - 1] += (n);	\
+} while (0)
+#define STAT(name, depth) STATADD(name, depth, 1)
+
+static inline long long
+stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+#define STATTIMER(t) long long t = stats_now()
+#define STATELAPSED(name, t) STATADD(name, 0, stats_now() - (t))
+
+static void
+stats_report(void)
+{
+	static long     sum[NSTATS][STATDEPTH];
+	struct statblock *b;
+	long            total;
+	int             i, d, json = getenv("STATS_JSON") != NULL, sep;
+
+	pthread_mutex_lock(&stats_lock);
+	memset(sum, 0, sizeof(sum));
+	for (b = stats_all; b; b = b->next)
+		for (i = 0; i < NSTATS; i++)
+			for (d = 0; d < STATDEPTH; d++)
+				sum[i][d] += b->c[i][d];
+	fprintf(stderr, json ? "{" : "%-20s %14s  by depth\n", "counter", "total");
+	for (i = 0; i < NSTATS; i++) {
+		for (total = d = 0; d < STATDEPTH; d++)
+			total += sum[i][d];
+		if (json)
+			fprintf(stderr, "%s\"%s\":{\"total\":%ld,\"depth\":{",
+				i ? "," : "", stats_names[i], total);
+		else
+			fprintf(stderr, "%-20s %14ld ", stats_names[i], total);
+		for (sep = d = 0; d < STATDEPTH; d++)
+			if (sum[i][d]) {
+				fprintf(stderr, json ? "%s\"%d\":%ld" : "%s%d:%ld",
+					json ? (sep ? "," : "") : " ", d, sum[i][d]);
+				sep = 1;
+			}
+		fprintf(stderr, json ? "}}" : "\n");
+	}
+	fprintf(stderr, json ? "}\n" : "\n");
+	fflush(stderr);
+	pthread_mutex_unlock(&stats_lock);
+}
+
+static void
+stats_signal(int sig)
+{
+	/* SIGUSR1: the next counter update prints the report */
+	stats_wanted = 1;
+}
+
+static void
+stats_init(void)
+{
+	signal(SIGUSR1, stats_signal);
+	atexit(stats_report);
+}
+
+#else
+
+#define STATADD(name, depth, n) do { } while (0)
+#define STAT(name, depth) do { } while (0)
+#define STATTIMER(t)
+#define STATELAPSED(name, t) do { } while (0)
+#define stats_init() do { } while (0)
+
+#endif
+
+#endif
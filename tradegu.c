@@ -1,4 +1,4 @@
-/* This is a program to check through n x n (n <= 8) Latin squares in a file to see if any of them have critical sets of 
+/* This is a program to check through n x n (n <= SIZE, 8 by default) Latin squares in a file to see if any of them have critical sets of 
  * n^2 / 4 - 1 (which can be modified to n^2 / 4 in the line with GRB_LESS_EQUAL)
  *
  * This program can be used to verify the results in the paper
@@ -8,15 +8,33 @@
  * the results in the paper.
  *
  * This version is from 9 July 2011. The next improvement is to use Knuth's Dancing Links algorithm for 
- * Latin square completions.
+ * Latin square completions.  The -d option now does this, using the engine in dlx.c.
  * This might be useful if anyone tries to use 4-row/col/elt trades to solve the conjecture about 8x8 squares
  * not having any critical sets of size 16 (except for the square based on Z_8) in the paper,
  * because it would make finding the trades much quicker.
+ * fill() itself gives up on a completion as soon as it must differ from the square in more
+ * than limit cells, so with a small limit the k = 4 trades are found several times faster than
+ * the run times below, which predate this; -d still enumerates every completion.
  *
- * The program requires the gurobi library and header files installed.
+ * The hitting set problem for the trades is solved by a built-in branch and bound on the
+ * trade bitmasks.  To use gurobi instead, which needs the gurobi library and header files installed,
+ * compile with -DGUROBI and link -lgurobi45.
  * Free academic licenses for gurobi are available from http://www.gurobi.com/html/academic.html
- * Compile with: gcc -O3 -o tradegu tradegu.c -lgurobi45
- * Usage: tradegu filename linestart lineend size k limit
+ * Compile with: gcc -O3 -o tradegu tradegu.c dlx.c sqfile.c -lpthread
+ * or: gcc -O3 -DGUROBI -o tradegu tradegu.c dlx.c sqfile.c -lgurobi45 -lpthread
+ * Larger orders need -DSIZE=n at compile time (e.g. -DSIZE=10); trades are then kept as
+ * multi-word bitsets, and -mavx2 or -msse4.1 vectorizes the subset tests.
+ * Squares of order 10 or more are read as letters, a = 1 (see sqfile.h).
+ * The file may also be in the packed format written by sqpack, which reaches linestart at once.
+ * Compiled with -DSTATS, search counters (see stats.h) go to stderr at exit and on SIGUSR1.
+ * Usage: tradegu [-d] [-j threads] [-L] [-t seconds] filename linestart lineend size k limit
+ * where: -d = find the trades with Dancing Links instead of fill()
+ * -j = process this many squares at once, one per thread (output stays in line order)
+ * -L = take the trades of k and limit as a start only: whenever the hitting set found does not
+ *      complete uniquely, the other completion is a trade it misses, which is added before solving
+ *      again.  The answer is then exact, whatever k and limit; "... 2 4" starts from the intercalates.
+ * -t = give up on the hitting set of a square after this many seconds (with -L, on all its rounds),
+ *      printing "stopped_early" for it and going on with the next
  * where: linestart = line to start at, lineend = line to end at (first line is 1)
  * size = order of Latin squares in file
  * k = maximum number of rows / columns / elements in trades from Latin square to consider
@@ -65,21 +83,156 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#ifdef GUROBI
 #include "gurobi_c.h"
+#endif
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+#include "dlx.h"
+#include "sqfile.h"
+
+/*
+ * counters kept with -DSTATS: fill() nodes, dead ends, and branches cut
+ * for the trade size limit or as giving trades kept from other lines, by
+ * level, add() calls, trades dropped as containing a known trade and known trades
+ * removed by a smaller one, by trade size, time spent solving in ns,
+ * hitset() nodes by the number of cells chosen, and trades added by -L by
+ * trade size
+ */
+#define STATS_COUNTERS(X) X(fill_nodes) X(fill_dead_ends) X(fill_limit_cuts) \
+	X(fill_owner_cuts) X(add_calls) X(add_dominated) X(add_removed) \
+	X(solve_ns) X(hitset_nodes) X(lazy_trades)
+#include "stats.h"
 
+#ifndef SIZE
 #define SIZE 8
-int             s1[SIZE][SIZE];
+#endif
+
+/*
+ * A set of cells (cell r*n + c is bit r*n + c) in WORDS 64-bit words: a
+ * trade, or the cells chosen to meet the trades.
+ */
+#define WORDS ((SIZE * SIZE + 63) / 64)
+
+typedef struct {
+	unsigned long   w[WORDS];
+} cells;
+
+static inline void
+setcell(cells * a, int i)
+{
+	a->w[i >> 6] |= 1UL << (i & 63);
+}
+
+static inline int
+hascell(const cells * a, int i)
+{
+	return a->w[i >> 6] >> (i & 63) & 1;
+}
+
+static inline int
+ncells(const cells * a)
+{
+	int             i, t = 0;
+
+	for (i = 0; i < WORDS; i++)
+		t += __builtin_popcountl(a->w[i]);
+	return t;
+}
+
+/*
+ * nonzero if a and b (or a and the complement of b, if comp) share a cell;
+ * the words are combined without branching, a vector at a time if possible
+ */
+static inline int
+overlap(const cells * a, const cells * b, int comp)
+{
+	int             i = 0;
+	unsigned long   x = 0;
+#ifdef __AVX2__
+	__m256i         v = _mm256_setzero_si256(), va, vb;
+
+	for (; i + 4 <= WORDS; i += 4) {
+		va = _mm256_loadu_si256((const __m256i *) (a->w + i));
+		vb = _mm256_loadu_si256((const __m256i *) (b->w + i));
+		v = _mm256_or_si256(v, comp ? _mm256_andnot_si256(vb, va) :
+				    _mm256_and_si256(va, vb));
+	}
+	x = !_mm256_testz_si256(v, v);
+#endif
+#ifdef __SSE4_1__
+	{
+		__m128i         u = _mm_setzero_si128(), ua, ub;
+
+		for (; i + 2 <= WORDS; i += 2) {
+			ua = _mm_loadu_si128((const __m128i *) (a->w + i));
+			ub = _mm_loadu_si128((const __m128i *) (b->w + i));
+			u = _mm_or_si128(u, comp ? _mm_andnot_si128(ub, ua) :
+					 _mm_and_si128(ua, ub));
+		}
+		x |= !_mm_testz_si128(u, u);
+	}
+#endif
+	for (; i < WORDS; i++)
+		x |= a->w[i] & (comp ? ~b->w[i] : b->w[i]);
+	return x != 0;
+}
+
+/* every cell of a is in b */
+static inline int
+subset(const cells * a, const cells * b)
+{
+	return !overlap(a, b, 1);
+}
+
+static inline int
+meets(const cells * a, const cells * b)
+{
+	return overlap(a, b, 0);
+}
+
+__thread int    s1[SIZE][SIZE];	/* the square whose trades are wanted */
+
+/*
+ * vfill() blanks k lines of one kind at a time: rows, columns or symbols.
+ * Blanking columns of s1 is blanking rows of its transpose, and blanking
+ * symbols is blanking rows of the conjugate with rows and symbols swapped,
+ * so every kind is done as rows of conjs[kind], and found() maps the cells
+ * of a trade back to s1.
+ *
+ * A trade is found from every k lines containing the lines it meets, and
+ * from every kind in which it meets k lines or fewer.  It is kept from one
+ * only: the first kind (rows, columns, symbols) in which it meets k lines
+ * or fewer, and there the lines it meets and then the first others, so
+ * that no blanked line after firstfree, the first line not blanked, is
+ * without a changed cell.
+ */
+__thread int    conjs[3][SIZE][SIZE];
+__thread int    kind;		/* of the lines being blanked */
+__thread unsigned long blanked;	/* the lines (SIZE <= 64) */
+__thread int    firstfree;
 int             limit;
+int             lazy;		/* -L */
+double          timelimit;	/* -t, seconds per square, 0 for none */
+__thread double deadline;	/* for the current square, 0 without -t */
 
-int             trades = 0;
+__thread int    trades = 0;	/* trades in the store */
 
-struct trade {
-	int             on;
-	int             filled;
-	unsigned long   sq;
+/*
+ * The trade store: the trades found so far, none containing another, kept
+ * in buckets by the number of cells.  A trade can only contain trades from
+ * smaller buckets and only be contained in trades from larger ones.
+ */
+struct bucket {
+	cells          *sq;
+	int             n, max;
 };
 
-struct trade   *tlist;
+__thread struct bucket tlist[SIZE * SIZE + 1];
 
 struct bitmap {
 	int             count;
@@ -87,38 +240,96 @@ struct bitmap {
 };
 
 int             fill(int s[SIZE][SIZE], int level, int pos, int size);
+void            found(int s[SIZE][SIZE], int size);
+
+__thread struct dlx *dlx;	/* Dancing Links engine, NULL unless -d */
+__thread struct dlx *dlxunique;	/* for -L, made on first use */
+
+/*
+ * fill() counts the cells of its completion so far that differ from
+ * conjs[kind]: in all, in each row and column, and the rows and columns with
+ * just one.  A trade meets each of its rows and columns at least twice, and
+ * a cell yet to differ gives a second to at most one row and one column, so
+ * a branch can only end in a trade of diffs + max(lonerows, lonecols) cells
+ * or more.
+ */
+__thread int    diffs, rowdiffs[SIZE], coldiffs[SIZE], lonerows, lonecols;
+
+/* count cell (r, c) as differing (d = 1) or no longer (d = -1) */
+static inline void
+differ(int r, int c, int d)
+{
+	lonerows -= rowdiffs[r] == 1;
+	lonecols -= coldiffs[c] == 1;
+	rowdiffs[r] += d;
+	coldiffs[c] += d;
+	lonerows += rowdiffs[r] == 1;
+	lonecols += coldiffs[c] == 1;
+	diffs += d;
+}
 
 void
-add(unsigned long d, int size, int filled)
+add(cells * d, int size, int filled)
 {
-	int             i;
-	struct trade   *more_trades;
-
-	if (trades == 0) {
-		tlist = (struct trade *) malloc(sizeof(struct trade));
-		tlist[0].sq = d;
-		tlist[0].on = 1;
-		tlist[0].filled = filled;
-		trades++;
-		return;
-	}
-	for (i = 0; i < trades; i++) {
-		if ((d & tlist[i].sq) == tlist[i].sq)
-			return;
-		if ((d & tlist[i].sq) == d)
-			tlist[i].on = 0;
+	struct bucket  *b;
+	cells          *more;
+	int             i, p;
+
+	STAT(add_calls, filled);
+	/* already met by a trade of this size or smaller? */
+	for (p = 1; p <= filled; p++)
+		for (b = &tlist[p], i = 0; i < b->n; i++)
+			if (subset(&b->sq[i], d)) {
+				STAT(add_dominated, filled);
+				return;
+			}
+
+	/* drop the larger trades containing this one */
+	for (p = filled + 1; p <= size * size; p++)
+		for (b = &tlist[p], i = 0; i < b->n; i++)
+			if (subset(d, &b->sq[i])) {
+				STAT(add_removed, p);
+				b->sq[i--] = b->sq[--b->n];
+				trades--;
+			}
+
+	b = &tlist[filled];
+	if (b->n == b->max) {
+		b->max = b->max ? 2 * b->max : 16;
+		more = (cells *) realloc(b->sq, b->max * sizeof(cells));
+		if (!more) {
+			printf("realloc failed\n");
+			exit(1);
+		}
+		b->sq = more;
 	}
+	b->sq[b->n++] = *d;
 	trades++;
-	more_trades = (struct trade *) realloc(tlist, sizeof(struct trade) * trades);
-	if (!more_trades) {
-		printf("realloc failed\n");
-		exit(1);
-	} else
-		tlist = more_trades;
-	tlist[trades - 1].sq = d;
-	tlist[trades - 1].on = 1;
-	tlist[trades - 1].filled = filled;
-	return;
+}
+
+/* empty the store, keeping its memory for the next square */
+void
+cleartrades(void)
+{
+	int             p;
+
+	for (p = 0; p <= SIZE * SIZE; p++)
+		tlist[p].n = 0;
+	trades = 0;
+}
+
+/* free the store's memory */
+void
+freetrades(void)
+{
+	int             p;
+
+	for (p = 0; p <= SIZE * SIZE; p++) {
+		free(tlist[p].sq);
+		tlist[p].sq = NULL;
+		tlist[p].n = tlist[p].max = 0;
+	}
+	trades = 0;
 }
 
 struct bitmap
@@ -163,42 +374,91 @@ testone(int s[SIZE][SIZE], int a, int b, int size)
 }
 
 int
-printt(unsigned long t, int size, int ind[SIZE * SIZE], double val[SIZE * SIZE])
+printt(cells * t, int size, int ind[SIZE * SIZE], double val[SIZE * SIZE])
 {
 	int             x, y, z = 0;
-	unsigned long   o = 1;
 
 	for (y = 0; y < size; y++)
 		for (x = 0; x < size; x++)
-			if (t & (o << (y * size + x))) {
+			if (hascell(t, y * size + x)) {
 				ind[z++] = y * size + x;
 				val[y * size + x] = 1;
 			}
 }
 
+static int
+dlxfound(int *sq, void *arg)
+{
+	found((int (*)[SIZE]) sq, *(int *) arg);
+	return 0;
+}
+
+/* find every completion of s, passing each to found() */
+void
+complete(int s[SIZE][SIZE], int level, int n)
+{
+	if (dlx)
+		dlx_complete(dlx, &s[0][0], 0, dlxfound, &n);
+	else
+		fill(s, level, 0, n);
+}
+
 int
 vfill(int *v, int n, int k)
 {
-	int             s[SIZE][SIZE], i, j, a;
-	memcpy(s, s1, sizeof(s));
-	for (i = 0; i < n; i++)
-		for (a = 0; a < k; a++)
-			s[v[a]][i] = 0;
-	fill(s, n * (n - k), 0, n);
+	int             s[SIZE][SIZE], i, a;
 
-	memcpy(s, s1, sizeof(s));
-	for (i = 0; i < n; i++)
+	for (blanked = a = 0; a < k; a++)
+		blanked |= 1UL << v[a];
+	firstfree = __builtin_ctzl(~blanked);
+	for (kind = 0; kind < 3; kind++) {
+		memcpy(s, conjs[kind], sizeof(s));
 		for (a = 0; a < k; a++)
-			s[i][v[a]] = 0;
-	fill(s, n * (n - k), 0, n);
+			for (i = 0; i < n; i++)
+				s[v[a]][i] = 0;
+		complete(s, n * (n - k), n);
+	}
+}
 
-	memcpy(s, s1, sizeof(s));
-	for (i = 0; i < n; i++)
-		for (j = 0; j < n; j++)
-			for (a = 0; a < k; a++)
-				if (s[i][j] - 1 == v[a])
-					s[i][j] = 0;
-	fill(s, n * (n - k), 0, n);
+/* nonzero if the trade meeting these lines is kept from this blanking */
+static int
+owned(unsigned long rows, unsigned long cols, unsigned long syms)
+{
+	unsigned long   met[3];
+	int             i, k = __builtin_popcountl(blanked);
+
+	met[0] = rows;
+	met[1] = cols;
+	met[2] = syms;
+	for (i = 0; i < kind; i++)
+		if (__builtin_popcountl(met[i]) <= k)
+			return 0;
+	return !(blanked & ~met[kind] & ~((2UL << firstfree) - 1));
+}
+
+void
+found(int s[SIZE][SIZE], int size)
+{
+	/* a completion s differing from conjs[kind] is a trade */
+	cells           d = {{0}};
+	unsigned long   rows = 0, cols = 0, syms = 0;
+	int             a, b, r, c, v, t = 0;
+	for (a = 0; a < size; a++)
+		for (b = 0; b < size; b++)
+			if (s[a][b] != conjs[kind][a][b]) {
+				/* the row, column and symbol (from 0) in s1 */
+				v = conjs[kind][a][b] - 1;
+				r = kind == 0 ? a : kind == 1 ? b : v;
+				c = kind == 1 ? a : b;
+				v = kind == 2 ? a : v;
+				setcell(&d, r * size + c);
+				rows |= 1UL << r;
+				cols |= 1UL << c;
+				syms |= 1UL << v;
+				t++;
+			}
+	if (t && t <= limit && owned(rows, cols, syms))
+		add(&d, size, t);
 }
 
 int
@@ -207,18 +467,10 @@ fill(int s[SIZE][SIZE], int level, int pos, int size)
 	struct bitmap   ret;
 	int             a, b, c, poss = 0;
 
+	STAT(fill_nodes, level);
 	if (level == size * size) {
-		unsigned long   d = 0;
-		unsigned long   o = 1;
-		int             t = 0;
-		for (a = 0; a < size; a++)
-			for (b = 0; b < size; b++)
-				if (s[a][b] != s1[a][b]) {
-					d |= (unsigned long) (o << (a * size + b));
-					t++;
-				}
-		if (d && t <= limit)
-			add(d, size, t);
+		if (diffs)	/* not conjs[kind] itself */
+			found(s, size);
 		return 1;
 	}
 	a = pos % size;
@@ -233,200 +485,799 @@ fill(int s[SIZE][SIZE], int level, int pos, int size)
 
 
 	ret = testone(s, b, a, size);
+	if (ret.count == 0)
+		STAT(fill_dead_ends, level);
 	for (c = 1; c <= size; c++) {
-		if (ret.values[c]) {
-			s[b][a] = c;
+		if (!ret.values[c])
+			continue;
+		s[b][a] = c;
+		if (c != conjs[kind][b][a])
+			differ(b, a, 1);
+		/* too big a trade by now, whatever comes next? */
+		if (diffs + (lonerows > lonecols ? lonerows : lonecols) > limit)
+			STAT(fill_limit_cuts, level);
+		/* a blanked row done unchanged, which the trade must not skip? */
+		else if (a == size - 1 && !rowdiffs[b] && blanked >> b & 1 &&
+			 b > firstfree)
+			STAT(fill_owner_cuts, level);
+		else
 			poss += fill(s, level + 1, b * size + a + 1, size);
-			s[b][a] = 0;
-		}
+		if (c != conjs[kind][b][a])
+			differ(b, a, -1);
+		s[b][a] = 0;
 	}
 	return poss;
 }
 
+/* the next square of the file, as read into sq; 0 at end of file */
 int
-main(int argc, char **argv)
+readsquare(struct sqfile * file, int sq[SIZE][SIZE])
+{
+	int             r = sqf_read(file, &sq[0][0], SIZE);
+
+	if (r < 0) {
+		printf("malformed square in file\n");
+		exit(1);
+	}
+	return r;
+}
+
+/* collect the trades of s1 from every k rows / columns / elements */
+void
+findtrades(int n, int k)
+{
+	int             i, j, v[SIZE + 2];
+
+	for (i = 0; i < n; i++)
+		for (j = 0; j < n; j++) {
+			conjs[0][i][j] = conjs[1][j][i] = s1[i][j];
+			conjs[2][s1[i][j] - 1][j] = i + 1;
+		}
+
+	/* do n choose k to find the trades */
+
+	for (i = 0; i < k; i++)
+		v[i] = i;
+	vfill(v, n, k);
+	v[k] = n;
+
+	while (v[0] < n - k) {
+		j = -1;
+		do {
+			j++;
+		} while (v[j + 1] <= v[j] + 1);
+
+		v[j]++;
+
+		for (i = 0; i < j; i++)
+			v[i] = i;
+
+		vfill(v, n, k);
+	}
+}
+
+/* seconds on a clock that only goes forward, for -t */
+static double
+now(void)
 {
-	int             s[SIZE][SIZE], i, j, n, len, k, *v, a, x, linestart, lineend,
-	                line;
-	FILE           *file;
-	char            str[100];
+	struct timespec ts;
 
-	GRBenv         *env = NULL;
-	GRBmodel       *model = NULL;
-	int             error = 0;
-	double          sol[SIZE * SIZE];
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * A hitting set for the nt trades of t, found greedily by taking the cell
+ * that meets the most trades not yet met until all are: a start for the
+ * solver.  t is reordered.  Returns its size, with its cells in set.
+ */
+static int
+greedy(cells * t, int nt, cells * set)
+{
+	int             freq[WORDS * 64], i, c, w, best, size = 0;
+	unsigned long   m;
+
+	memset(set, 0, sizeof(*set));
+	while (nt) {
+		memset(freq, 0, sizeof(freq));
+		for (i = 0; i < nt; i++)
+			for (w = 0; w < WORDS; w++)
+				for (m = t[i].w[w]; m; m &= m - 1)
+					freq[64 * w + __builtin_ctzl(m)]++;
+		for (best = c = 0; c < WORDS * 64; c++)
+			if (freq[c] > freq[best])
+				best = c;
+		setcell(set, best);
+		size++;
+		/* drop the trades it meets */
+		for (i = 0; i < nt;)
+			if (hascell(&t[i], best))
+				t[i] = t[--nt];
+			else
+				i++;
+	}
+	return size;
+}
+
+#ifdef GUROBI
+
+/*
+ * Each thread keeps one Gurobi environment and one model for the whole run:
+ * the n*n variables and the size constraint are the same for every square,
+ * so only the trade constraints are replaced from one solve to the next.
+ */
+__thread GRBenv *env;
+__thread GRBmodel *model;
+
+/* the variables and the size constraint */
+static int
+newmodel(int n)
+{
 	int             ind[SIZE * SIZE];
 	double          val[SIZE * SIZE];
 	double          obj[SIZE * SIZE];
 	char            vtype[SIZE * SIZE];
-	int             optimstatus;
-	double          objval;
+	int             error, i;
 
-	if (argc != 7) {
-		printf("usage: %s filename linestart lineend size k limit\n", argv[0]);
-		exit(0);
+	if (env == NULL) {
+		error = GRBloadenv(&env, NULL);
+		if (error || env == NULL) {
+			fprintf(stderr, "Error: could not create environment\n");
+			exit(1);
+		}
+		error = GRBsetintparam(env, "OutputFlag", 0);
+		if (error)
+			return error;
 	}
-	if ((file = fopen(argv[1], "r")) == NULL) {
-		printf("failed to open %s\n", argv[1]);
-		exit(0);
+	error = GRBnewmodel(env, &model, "mip1", 0, NULL, NULL, NULL, NULL, NULL);
+	if (error)
+		return error;
+
+	for (i = 0; i < n * n; i++) {
+		obj[i] = 1;
+		vtype[i] = GRB_BINARY;
 	}
-	linestart = atoi(argv[2]);
-	lineend = atoi(argv[3]);
-	n = atoi(argv[4]);
-	k = atoi(argv[5]);
-	limit = atoi(argv[6]);
+	error = GRBaddvars(model, n * n, 0, NULL, NULL, NULL, obj, NULL, NULL, vtype,
+			   NULL);
+	if (error)
+		return error;
+	error = GRBupdatemodel(model);
+	if (error)
+		return error;
 
-	v = malloc((n + 2) * sizeof(int));	/* for doing n choose k soon */
+	/*
+	 * First constraint: we're looking for a solution of size <= n*n/4 - 1
+	 */
 
-	/* go to linestart */
+	for (i = 0; i < n * n; i++) {
+		ind[i] = i;
+		val[i] = 1;
+	}
+	return GRBaddconstr(model, n * n, ind, val, GRB_LESS_EQUAL, n * n / 4 - 1, NULL);
+}
 
-	for (i = 1; i < linestart; i++)
-		for (j = 0; j < n; j++)
-			fscanf(file, "%s", str);
+/*
+ * Solve the hitting set MIP for the trades in tlist, writing the answer for
+ * the square into result.  Returns 1 if there is a solution, with its cells
+ * in pick.
+ */
+int
+solve(int n, char *result, cells * pick)
+{
+	int             error = 0, solved = 0;
+	int             ind[SIZE * SIZE], *del;
+	double          val[SIZE * SIZE], x[SIZE * SIZE];
+	int             optimstatus, m;
+	double          objval, left;
+	int             i, p, nt = 0, start;
+	cells          *t, g;
+
+	if (model == NULL) {
+		error = newmodel(n);
+		if (error)
+			goto QUIT;
+	} else {
+		/* drop the trade constraints of the last solve */
+		error = GRBgetintattr(model, GRB_INT_ATTR_NUMCONSTRS, &m);
+		if (error)
+			goto QUIT;
+		if (m > 1) {
+			del = (int *) malloc((m - 1) * sizeof(int));
+			if (!del) {
+				printf("malloc failed\n");
+				exit(1);
+			}
+			for (i = 1; i < m; i++)
+				del[i - 1] = i;
+			error = GRBdelconstrs(model, m - 1, del);
+			free(del);
+			if (error)
+				goto QUIT;
+		}
+	}
 
-	/* Create environment */
+	/*
+	 * other constraints: must have at least one entry in each trade
+	 */
 
-	error = GRBloadenv(&env, NULL);
-	if (error || env == NULL) {
-		fprintf(stderr, "Error: could not create environment\n");
+	t = (cells *) malloc((trades + 1) * sizeof(cells));
+	if (!t) {
+		printf("malloc failed\n");
 		exit(1);
 	}
-	error = GRBsetintparam(env, "OutputFlag", 0);
+	for (p = 1; p <= n * n; p++)
+		for (i = 0; i < tlist[p].n; i++) {
+			t[nt++] = tlist[p].sq[i];
+			printt(&tlist[p].sq[i], n, ind, val);
+			error = GRBaddconstr(model, p, ind, val, GRB_GREATER_EQUAL, 1.0, NULL);
+			if (error) {
+				free(t);
+				goto QUIT;
+			}
+		}
+
+	/* start from the greedy hitting set if it is small enough */
+
+	start = greedy(t, nt, &g) <= n * n / 4 - 1;
+	free(t);
+	for (i = 0; i < n * n; i++)
+		x[i] = start ? hascell(&g, i) : GRB_UNDEFINED;
+	error = GRBupdatemodel(model);
+	if (error)
+		goto QUIT;
+	error = GRBsetdblattrarray(model, GRB_DBL_ATTR_START, 0, n * n, x);
 	if (error)
 		goto QUIT;
+	if (deadline) {
+		left = deadline - now();
+		error = GRBsetdblparam(GRBgetenv(model), "TimeLimit",
+				       left > 0 ? left : 0);
+		if (error)
+			goto QUIT;
+	}
 
-	for (line = linestart; line <= lineend; line++) {
-		printf("%d ", line);
-		fflush(stdout);
-		for (i = 0; i < n; i++) {
-			fscanf(file, "%s", str);
-			for (j = 0; j < n; j++)
-				s1[i][j] = str[j] - '0';
-		}
+	/* Optimize model */
 
-		/* do n choose k to find the trades */
+	error = GRBoptimize(model);
+	if (error)
+		goto QUIT;
 
+	/* Write model to 'mip1.lp' */
 
-		for (i = 0; i < k; i++)
-			v[i] = i;
-		vfill(v, n, k);
-		v[k] = n;
+	/*
+	 * error = GRBwrite(model, "mip1.lp"); if (error) goto QUIT;
+	 */
 
-		while (v[0] < n - k) {
-			j = -1;
-			do {
-				j++;
-			} while (v[j + 1] <= v[j] + 1);
+	error = GRBgetintattr(model, GRB_INT_ATTR_STATUS, &optimstatus);
+	if (error)
+		goto QUIT;
 
-			v[j]++;
+	if (optimstatus == GRB_OPTIMAL) {
+		error = GRBgetdblattr(model, GRB_DBL_ATTR_OBJVAL,
+				      &objval);
+		if (error)
+			goto QUIT;
+		sprintf(result, "%d", (int) objval);	/* solution found */
+		error = GRBgetdblattrarray(model, GRB_DBL_ATTR_X, 0, n * n, x);
+		if (error)
+			goto QUIT;
+		memset(pick, 0, sizeof(*pick));
+		for (i = 0; i < n * n; i++)
+			if (x[i] > 0.5)
+				setcell(pick, i);
+		solved = 1;
+	} else if (optimstatus == GRB_INFEASIBLE) {
+		sprintf(result, "infeasible");
+	} else {
+		sprintf(result, "stopped_early%d", optimstatus);
+	}
 
-			for (i = 0; i < j; i++)
-				v[i] = i;
+QUIT:
 
-			vfill(v, n, k);
-		}
+	/* Error reporting */
 
+	if (error) {
+		printf("ERROR: %s\n", GRBgeterrormsg(env));
+		exit(1);
+	}
+	return solved;
+}
 
-		/* Create an empty model */
+void
+endsolver(void)
+{
+	GRBfreemodel(model);
+	model = NULL;
+	GRBfreeenv(env);
+	env = NULL;
+}
 
-		error = GRBnewmodel(env, &model, "mip1", 0, NULL, NULL, NULL, NULL, NULL);
-		if (error)
-			goto QUIT;
+#else
 
+/*
+ * The built-in solver: branch and bound for the smallest set of cells that
+ * meets every trade, working on the trade bitsets directly.
+ */
 
-		/* Add variables */
+__thread int    hsbest;		/* size of the best hitting set so far */
+__thread int    hspath[SIZE * SIZE];	/* the cells chosen on the way down */
+__thread cells  hsbestset;	/* the cells of the best set */
+__thread long   hsnodes;	/* since the clock was last read */
+__thread int    hsstop;		/* the deadline has passed */
+__thread cells *hswork;		/* kept from square to square */
+__thread long   hsroom;
+
+/*
+ * hitset() only looks for dominated trades among fewer than UNDOMINATED:
+ * the test is quadratic, and near the root, where there are the most trades,
+ * it would cost more than the nodes it saves
+ */
+#define UNDOMINATED 64
 
-		for (i = 0; i < n * n; i++) {
-			obj[i] = 1;
-			vtype[i] = GRB_BINARY;
+/*
+ * drop the trades of t that contain another: any set meeting the smaller
+ * trade meets them too.  t is sorted by size first (cells ruled out in
+ * hitset() leave it unsorted), so that a trade is only tested against the
+ * ones kept before it.  Returns the number kept.
+ */
+static int
+undominated(cells * t, int nt)
+{
+	int             size[UNDOMINATED], i, j, kept = 0, z;
+	cells           x;
+
+	for (i = 0; i < nt; i++) {
+		x = t[i];
+		z = ncells(&x);
+		for (j = i; j > 0 && size[j - 1] > z; j--) {
+			t[j] = t[j - 1];
+			size[j] = size[j - 1];
 		}
-		error = GRBaddvars(model, n * n, 0, NULL, NULL, NULL, obj, NULL, NULL, vtype,
-				   NULL);
-		if (error)
-			goto QUIT;
+		t[j] = x;
+		size[j] = z;
+	}
+	for (i = 0; i < nt; i++) {
+		for (j = 0; j < kept; j++)
+			if (subset(&t[j], &t[i]))
+				break;
+		if (j == kept)
+			t[kept++] = t[i];
+	}
+	return kept;
+}
 
-		/* Integrate new variables */
+/*
+ * t[0..nt-1] are the trades not yet met by the chosen cells, with the cells
+ * already ruled out removed; work has room for the trades of the deeper
+ * levels.
+ */
+static void
+hitset(cells * t, int nt, int chosen, cells * work)
+{
+	int             freq[WORDS * 64], i, c, w, best, lb, most = 0;
+	int             size, smallsize = SIZE * SIZE + 1;
+	cells           smallest = {{0}}, used = {{0}}, out = {{0}};
+	unsigned long   m;
+
+	STAT(hitset_nodes, chosen);
+	if (deadline && ++hsnodes >= 4096) {
+		hsnodes = 0;
+		hsstop = now() > deadline;
+	}
+	if (hsstop)
+		return;
+	if (nt == 0) {
+		if (chosen < hsbest) {
+			hsbest = chosen;
+			memset(&hsbestset, 0, sizeof(hsbestset));
+			for (i = 0; i < chosen; i++)
+				setcell(&hsbestset, hspath[i]);
+		}
+		return;
+	}
+	/* trades ruled out entirely cannot be met below here */
+	memset(freq, 0, sizeof(freq));
+	for (i = 0; i < nt; i++) {
+		size = ncells(&t[i]);
+		if (!size)
+			return;
+		if (size < smallsize) {
+			smallsize = size;
+			smallest = t[i];
+		}
+		for (w = 0; w < WORDS; w++)
+			for (m = t[i].w[w]; m; m &= m - 1)
+				freq[64 * w + __builtin_ctzl(m)]++;
+	}
 
-		error = GRBupdatemodel(model);
-		if (error)
-			goto QUIT;
+	/*
+	 * Lower bounds: pairwise disjoint trades each need their own cell,
+	 * and no cell meets more than the most frequent cell does.
+	 */
+	lb = 0;
+	for (i = 0; i < nt; i++)
+		if (!meets(&t[i], &used)) {
+			for (w = 0; w < WORDS; w++)
+				used.w[w] |= t[i].w[w];
+			lb++;
+		}
+	if (chosen + lb >= hsbest)
+		return;
+	for (c = 0; c < WORDS * 64; c++)
+		if (freq[c] > most)
+			most = freq[c];
+	if (chosen + (nt + most - 1) / most >= hsbest)
+		return;
 
-		/*
-		 * First constraint: we're looking for a solution of size <=
-		 * n*n/4 - 1
-		 */
+	/*
+	 * Some cell of the smallest trade must be chosen: try each, most
+	 * frequent first, ruling out the ones already tried.
+	 */
+	while (smallsize--) {
+		best = -1;
+		for (w = 0; w < WORDS; w++)
+			for (m = smallest.w[w]; m; m &= m - 1) {
+				c = 64 * w + __builtin_ctzl(m);
+				if (best < 0 || freq[c] > freq[best])
+					best = c;
+			}
+		smallest.w[best >> 6] &= ~(1UL << (best & 63));
+
+		lb = 0;
+		for (i = 0; i < nt; i++)
+			if (!hascell(&t[i], best)) {
+				for (w = 0; w < WORDS; w++)
+					work[lb].w[w] = t[i].w[w] & ~out.w[w];
+				lb++;
+			}
+		if (lb < UNDOMINATED)
+			lb = undominated(work, lb);
+		hspath[chosen] = best;
+		hitset(work, lb, chosen + 1, work + lb);
+		if (chosen + 1 >= hsbest || hsstop)
+			return;
+		setcell(&out, best);
+	}
+}
 
-		for (i = 0; i < n * n; i++) {
-			ind[i] = i;
-			val[i] = 1;
+/*
+ * Find the smallest hitting set of the trades in tlist, writing the answer
+ * for the square into result: its size if there is one of at most
+ * n*n/4 - 1 cells, otherwise "infeasible", or "stopped_early" if the
+ * deadline of -t passed first.  Returns 1 if there is one, with its cells in
+ * pick.
+ */
+int
+solve(int n, char *result, cells * pick)
+{
+	cells          *t, g;
+	int             i, p, nt = 0, bound = n * n / 4 - 1, size;
+	long            room = (trades + 1) * (long) (bound + 2);
+
+	if (room > hsroom) {
+		free(hswork);
+		hswork = (cells *) malloc(room * sizeof(cells));
+		if (!hswork) {
+			printf("malloc failed\n");
+			exit(1);
 		}
+		hsroom = room;
+	}
+	t = hswork;
+	/* smallest first; the store holds no dominated trades */
+	for (p = 1; p <= n * n; p++)
+		for (i = 0; i < tlist[p].n; i++)
+			t[nt++] = tlist[p].sq[i];
+
+	/* the greedy set, if small enough, is the one to beat */
+	memcpy(t + nt, t, nt * sizeof(cells));
+	size = greedy(t + nt, nt, &g);
+	if (size <= bound) {
+		hsbest = size;
+		hsbestset = g;
+	} else
+		hsbest = bound + 1;
+	hsstop = 0;
+	hitset(t, nt, 0, t + nt);
+	if (hsstop) {
+		sprintf(result, "stopped_early");
+		return 0;
+	}
+	if (hsbest > bound) {
+		sprintf(result, "infeasible");
+		return 0;
+	}
+	sprintf(result, "%d", hsbest);
+	*pick = hsbestset;
+	return 1;
+}
 
-		error = GRBaddconstr(model, n * n, ind, val, GRB_LESS_EQUAL, n * n / 4 - 1, NULL);
-		if (error)
-			goto QUIT;
+void
+endsolver(void)
+{
+	free(hswork);
+	hswork = NULL;
+	hsroom = 0;
+}
 
-		/*
-		 * other constraints: must have at least one entry in each
-		 * trade
-		 */
+#endif
 
-		for (i = 0; i < trades; i++) {
-			if (tlist[i].on) {
-				printt(tlist[i].sq, n, ind, val);
-				error = GRBaddconstr(model, tlist[i].filled, ind, val, GRB_GREATER_EQUAL, 1.0, NULL);
-				if (error)
-					goto QUIT;
-			}
-		}
+struct other {
+	int             n, differs, s[SIZE][SIZE];
+};
 
-		/* Optimize model */
+/* stop at the first completion that is not s1, keeping it */
+static int
+dlxother(int *sq, void *arg)
+{
+	struct other   *o = (struct other *) arg;
+	int             r, c;
+
+	for (r = 0; r < o->n; r++)
+		for (c = 0; c < o->n; c++)
+			if ((o->s[r][c] = sq[r * SIZE + c]) != s1[r][c])
+				o->differs = 1;
+	return o->differs;
+}
 
-		error = GRBoptimize(model);
-		if (error)
-			goto QUIT;
+/*
+ * the cells where s1 and another completion of the cells of s1 in fixed
+ * differ into d, if there is one; returns how many, 0 if none
+ */
+static int
+other(int n, const cells * fixed, cells * d)
+{
+	struct other    o;
+	int             s[SIZE][SIZE], r, c, t = 0;
+
+	if (!dlxunique)
+		dlxunique = dlx_new(n, SIZE);
+	memset(s, 0, sizeof(s));
+	for (r = 0; r < n; r++)
+		for (c = 0; c < n; c++)
+			if (hascell(fixed, r * n + c))
+				s[r][c] = s1[r][c];
+	o.n = n;
+	o.differs = 0;
+	dlx_complete(dlxunique, &s[0][0], 2, dlxother, &o);
+	if (!o.differs)
+		return 0;
+	memset(d, 0, sizeof(*d));
+	for (r = 0; r < n; r++)
+		for (c = 0; c < n; c++)
+			if (o.s[r][c] != s1[r][c]) {
+				setcell(d, r * n + c);
+				t++;
+			}
+	return t;
+}
 
-		/* Write model to 'mip1.lp' */
+/*
+ * -L: the cells of s1 in pick meet every trade in the store.  While some
+ * other completion keeps them, the trade it makes is cut down to a minimal
+ * one and added, and one of its cells joins them, so that a round adds
+ * every trade needed to fix s1 from pick.  Returns the trades added.
+ */
+int
+refute(int n, cells * pick)
+{
+	cells           fixed = *pick, d, e, f;
+	int             added = 0, t, u, q, i;
 
+	while ((t = other(n, &fixed, &d)) > 0) {
 		/*
-		 * error = GRBwrite(model, "mip1.lp"); if (error) goto QUIT;
+		 * fixing every cell outside d and one inside, another trade
+		 * inside d leaves out that cell; a cell that fails for d fails
+		 * for every trade inside it, so one pass is enough
 		 */
+		for (q = 0; q < n * n; q++) {
+			if (!hascell(&d, q))
+				continue;
+			for (i = 0; i < WORDS; i++)
+				f.w[i] = ~d.w[i];
+			setcell(&f, q);
+			if ((u = other(n, &f, &e)) > 0) {
+				d = e;
+				t = u;
+			}
+		}
+		STAT(lazy_trades, t);
+		add(&d, n, t);
+		added++;
+		for (q = 0; !hascell(&d, q); q++)
+			;
+		setcell(&fixed, q);
+	}
+	return added;
+}
 
-		error = GRBgetintattr(model, GRB_INT_ATTR_STATUS, &optimstatus);
-		if (error)
-			goto QUIT;
+/*
+ * one square: find its trades, then solve the hitting set problem, with -L
+ * until the set found completes uniquely, and with -t until its time is up
+ */
+void
+process(int n, int k, char *result)
+{
+	cells           pick;
+	int             solved;
+
+	findtrades(n, k);
+	deadline = timelimit > 0 ? now() + timelimit : 0;
+	do {
+		STATTIMER(t);
+		solved = solve(n, result, &pick);
+		STATELAPSED(solve_ns, t);
+	} while (lazy && solved && refute(n, &pick));
+	cleartrades();
+}
 
-		if (optimstatus == GRB_OPTIMAL) {
-			error = GRBgetdblattr(model, GRB_DBL_ATTR_OBJVAL,
-					      &objval);
-			if (error)
-				goto QUIT;
-			printf("%d\n", (int) objval); /* solution found */
-		} else if (optimstatus == GRB_INFEASIBLE) {
-			printf("infeasible\n");
-		} else {
-			printf("stopped_early%d\n", optimstatus); 
+/*
+ * Batch mode (-j): each thread takes the next square from the file, finds
+ * its trades and solves its hitting set problem with its own s1, trade list
+ * and solver.  Results are kept until every earlier line has been printed.
+ */
+
+struct {
+	struct sqfile  *file;
+	int             n, k, usedlx;
+	int             next, linestart, lineend;
+	char          (*result)[24];	/* "" until the line is done */
+	int             printed;	/* lines printed so far */
+	pthread_mutex_t lock;
+	pthread_cond_t  done;
+} batch;
+
+void           *
+worker(void *arg)
+{
+	int             line, n = batch.n;
+	char            result[24];
+
+	if (batch.usedlx)
+		dlx = dlx_new(n, SIZE);
+
+	for (;;) {
+		pthread_mutex_lock(&batch.lock);
+		line = batch.next;
+		if (line > batch.lineend || !readsquare(batch.file, s1)) {
+			pthread_mutex_unlock(&batch.lock);
+			break;
 		}
-		fflush(stdout);
+		batch.next++;
+		pthread_mutex_unlock(&batch.lock);
+
+		process(n, batch.k, result);
+		pthread_mutex_lock(&batch.lock);
+		strcpy(batch.result[line - batch.linestart], result);
+		pthread_cond_signal(&batch.done);
+		pthread_mutex_unlock(&batch.lock);
+	}
+	/* wake the printer in case the file ran out early */
+	pthread_mutex_lock(&batch.lock);
+	pthread_cond_signal(&batch.done);
+	pthread_mutex_unlock(&batch.lock);
+
+	endsolver();
+	freetrades();
+	dlx_free(dlx);
+	dlx_free(dlxunique);
+	return NULL;
+}
 
-		/* Free model */
-	
-		GRBfreemodel(model);
-		if (trades) free(tlist);
-		trades = 0;
+void
+runbatch(int threads)
+{
+	pthread_t      *tid;
+	int             i, lines = batch.lineend - batch.linestart + 1;
+
+	batch.next = batch.linestart;
+	batch.printed = 0;
+	batch.result = calloc(lines, sizeof(*batch.result));
+	tid = malloc(threads * sizeof(pthread_t));
+	if (!batch.result || !tid) {
+		printf("malloc failed\n");
+		exit(1);
+	}
+	pthread_mutex_init(&batch.lock, NULL);
+	pthread_cond_init(&batch.done, NULL);
+	for (i = 0; i < threads; i++)
+		pthread_create(&tid[i], NULL, worker, NULL);
+
+	/* print in line order as results come in */
+	pthread_mutex_lock(&batch.lock);
+	while (batch.printed < lines) {
+		char           *r = batch.result[batch.printed];
+
+		if (*r) {
+			printf("%d %s\n", batch.linestart + batch.printed, r);
+			fflush(stdout);
+			batch.printed++;
+		} else if (batch.next - batch.linestart == batch.printed &&
+			   (batch.next > batch.lineend || sqf_eof(batch.file)))
+			break;	/* nothing more will come */
+		else
+			pthread_cond_wait(&batch.done, &batch.lock);
 	}
+	pthread_mutex_unlock(&batch.lock);
 
-QUIT:
+	for (i = 0; i < threads; i++)
+		pthread_join(tid[i], NULL);
+	free(tid);
+	free(batch.result);
+}
 
-	/* Error reporting */
+int
+main(int argc, char **argv)
+{
+	int             n, k, linestart, lineend, line;
+	struct sqfile  *file;
+	char            result[24];
+
+	int             opt, usedlx = 0, threads = 0;
+
+	stats_init();
+
+	while ((opt = getopt(argc, argv, "dj:Lt:")) != -1) {
+		if (opt == 'd')
+			usedlx = 1;
+		else if (opt == 'L')
+			lazy = 1;
+		else if (opt == 't' && atof(optarg) > 0)
+			timelimit = atof(optarg);
+		else if (opt == 'j' && atoi(optarg) > 0)
+			threads = atoi(optarg);
+		else
+			argc = 0;
+	}
+	if (argc - optind != 6) {
+		printf("usage: %s [-d] [-j threads] [-L] [-t seconds] filename linestart lineend size k limit\n", argv[0]);
+		exit(0);
+	}
+	argv += optind - 1;
+	linestart = atoi(argv[2]);
+	lineend = atoi(argv[3]);
+	n = atoi(argv[4]);
+	k = atoi(argv[5]);
+	limit = atoi(argv[6]);
+	if (n > SIZE) {
+		printf("size must be at most %d (compile with -DSIZE=%d)\n", SIZE, n);
+		exit(0);
+	}
+	if ((file = sqf_open(argv[1], n)) == NULL)
+		exit(0);
 
-	if (error) {
-		printf("ERROR: %s\n", GRBgeterrormsg(env));
-		exit(1);
+	/* go to linestart (at once in a packed file) */
+
+	sqf_skip(file, linestart - 1);
+
+	if (threads) {
+		batch.file = file;
+		batch.n = n;
+		batch.k = k;
+		batch.usedlx = usedlx;
+		batch.linestart = linestart;
+		batch.lineend = lineend;
+		runbatch(threads);
+		sqf_close(file);
+		return 0;
 	}
-	/* Free environment */
+	if (usedlx)
+		dlx = dlx_new(n, SIZE);
 
-	GRBfreeenv(env);
-	fclose(file);
+	for (line = linestart; line <= lineend; line++) {
+		if (!readsquare(file, s1))
+			break;
+		printf("%d ", line);
+		fflush(stdout);
+
+		process(n, k, result);
+		printf("%s\n", result);
+		fflush(stdout);
+	}
+
+	endsolver();
+	freetrades();
+	sqf_close(file);
 
 	return 0;
 }